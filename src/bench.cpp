@@ -0,0 +1,812 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <list>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+
+#include "../autoconf.h"
+#include "radiance.h"
+#include "config.h"
+#include "logger.h"
+#include "database.h"
+#include "site_comm.h"
+#include "worker.h"
+#include "response.h"
+#include "misc_functions.h"
+#include "user.h"
+#include "domain.h"
+#include "rcu.h"
+#include "ip_address.h"
+#include "percent_decode.h"
+#include "pool.h"
+#include "timing_wheel.h"
+
+/*
+ * Offline microbenchmarks for the request hot path (make bench).
+ *
+ * The database runs in readonly mode and nothing is ever loaded from it, so
+ * no MySQL server is needed; the record_* buffers are discarded by flush()
+ * between repetitions. All users, torrents, peers and requests are generated
+ * from a fixed seed and every benchmark runs a fixed number of iterations, so
+ * two runs of the same build on the same machine are directly comparable.
+ *
+ * Usage: radiance-bench [-r repetitions] [-s scale] [filter ...]
+ *   -r  timed repetitions per benchmark, the median is reported (default 5)
+ *   -s  multiply every iteration count by this factor (default 1)
+ *   filter  only run benchmarks whose name contains one of these strings
+ */
+
+// The tracker globals normally live in radiance.cpp
+struct stats_t stats;
+settings *conf;
+options  *opts;
+
+static const uint32_t bench_seed = 0x52414449;
+static volatile size_t sink; // Results are folded in here so the work can't be optimised away
+
+static torrent_list torrents;
+static user_list    users;
+static domain_list  domains;
+static client_blacklist blacklist;
+static database  *db;
+static site_comm *sc;
+static worker    *work;
+
+static std::mt19937 rng(bench_seed);
+static std::vector<std::string> passkeys;
+
+struct benchmark {
+	std::string name;
+	size_t iterations;
+	std::function<void(size_t)> run;
+};
+
+static std::string random_alnum(size_t length) {
+	static const char chars[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	std::string out;
+	for (size_t i = 0; i < length; i++) {
+		out.push_back(chars[rng() % (sizeof(chars) - 1)]);
+	}
+	return out;
+}
+
+static std::string random_bytes(size_t length) {
+	std::string out;
+	for (size_t i = 0; i < length; i++) {
+		out.push_back(static_cast<char>(rng() & 0xFF));
+	}
+	return out;
+}
+
+// Public addresses only, private ones would be rejected by the worker
+static std::string random_ipv4() {
+	static const unsigned int first_octets[] = { 23, 31, 45, 62, 77, 81, 89, 94, 185, 213 };
+	return std::to_string(first_octets[rng() % 10]) + '.' + std::to_string(rng() % 256) + '.'
+		+ std::to_string(rng() % 256) + '.' + std::to_string(1 + rng() % 254);
+}
+
+static ip_address client_address(const std::string &text) {
+	ip_address addr = {};
+	parse_ip(text, addr);
+	return addr;
+}
+
+// Percent-encode like most clients do, leaving unreserved characters alone
+static std::string url_encode(const std::string &in) {
+	static const char hex[] = "0123456789ABCDEF";
+	std::string out;
+	for (unsigned char c: in) {
+		if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+			out.push_back(c);
+		} else {
+			out.push_back('%');
+			out.push_back(hex[c >> 4]);
+			out.push_back(hex[c & 0xF]);
+		}
+	}
+	return out;
+}
+
+static const std::string request_headers =
+	" HTTP/1.1\r\nHost: tracker.example.org\r\nUser-Agent: qBittorrent/4.3.9\r\nAccept-Encoding: gzip\r\nConnection: close\r\n\r\n";
+
+static std::string announce_request(const std::string &passkey, const std::string &info_hash, const std::string &peer_id,
+		int64_t left, unsigned int numwant, const std::string &event) {
+	std::string request = "GET /" + passkey + "/announce?info_hash=" + url_encode(info_hash)
+		+ "&peer_id=" + url_encode(peer_id) + "&port=51413&uploaded=0&downloaded=0&left=" + std::to_string(left)
+		+ "&corrupt=0&key=1A2B3C4D&numwant=" + std::to_string(numwant) + "&compact=1&no_peer_id=1";
+	if (!event.empty()) {
+		request += "&event=" + event;
+	}
+	return request + request_headers;
+}
+
+static std::string scrape_request(const std::string &passkey, const std::vector<std::string> &info_hashes) {
+	std::string request = "GET /" + passkey + "/scrape?";
+	for (size_t i = 0; i < info_hashes.size(); i++) {
+		request += (i == 0 ? "info_hash=" : "&info_hash=") + url_encode(info_hashes[i]);
+	}
+	return request + request_headers;
+}
+
+static torrent_list::iterator add_torrent(torid_t id, torrent_list &list = torrents) {
+	torrent t;
+	t.id = id;
+	t.completed = 0;
+	t.paused = 0;
+	t.balance = 0;
+	t.free_torrent = NORMAL;
+	t.double_torrent = NORMAL;
+	t.last_flushed = 0;
+	std::string info_hash;
+	do {
+		info_hash = random_bytes(20);
+	} while (list.find(info_hash) != list.end());
+	return list.insert(std::pair<std::string, torrent>(info_hash, t)).first;
+}
+
+// Steady-state re-announces ready to replay, with what the handlers get for each
+struct replay_set {
+	std::vector<std::string> requests;
+	std::vector<ip_address> ips;
+	std::vector<params_type> params;
+	std::vector<user_ptr> users;
+};
+
+// A new peer announcing through w, its re-announce is kept in replay if there is one
+static void announce_peer(worker *w, const std::string &info_hash, int64_t left, replay_set *replay) {
+	const std::string &passkey = passkeys[rng() % passkeys.size()];
+	std::string peer_id = "-qB4390-" + random_alnum(12);
+	ip_address ip = client_address(random_ipv4());
+	client_opts_t client_opts = {false, false, false, false, false};
+	sink += w->work(announce_request(passkey, info_hash, peer_id, left, 0, "started"), ip, client_opts).size();
+	if (replay == nullptr) {
+		return;
+	}
+
+	replay->requests.push_back(announce_request(passkey, info_hash, peer_id, left, 50, ""));
+	replay->ips.push_back(ip);
+	replay->users.push_back(users[passkey]);
+	params_type params;
+	params["info_hash"] = url_encode(info_hash);
+	params["peer_id"] = url_encode(peer_id);
+	params["port"] = "51413";
+	params["uploaded"] = "0";
+	params["downloaded"] = "0";
+	params["left"] = std::to_string(left);
+	params["corrupt"] = "0";
+	params["numwant"] = "50";
+	params["compact"] = "1";
+	replay->params.push_back(params);
+}
+
+// A torrent with the given number of peers, half of them seeding, and the
+// re-announces of up to 256 of its leechers
+struct swarm : replay_set {
+	std::string info_hash;
+};
+
+static swarm make_swarm(torid_t id, size_t size) {
+	swarm s;
+	s.info_hash = add_torrent(id)->first;
+	work->rebuild_torrent_filter();
+	for (size_t i = 0; i < size; i++) {
+		int64_t left = (i % 2 == 0) ? 0 : 1048576;
+		announce_peer(work, s.info_hash, left, (left > 0 && s.requests.size() < 256) ? &s : nullptr);
+	}
+	const torrent &t = torrents.find(s.info_hash)->second;
+	if (t.seeders.size() + t.leechers.size() != size) {
+		std::cerr << "Swarm " << id << " has " << t.seeders.size() + t.leechers.size() << " peers, expected " << size << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	db->flush();
+	return s;
+}
+
+static void check_failed(const std::string &what) {
+	std::cerr << "Check failed: " << what << std::endl;
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Not a benchmark, run once before them: re-adding a torrent that still has
+ * peers and a token has to give back their counts, and a reaper pass past all
+ * of their deadlines must not find them on its wheel any more.
+ */
+static void check_readd_torrent() {
+	torrent_list list;
+	worker w(list, users, domains, blacklist, db, sc);
+	std::string info_hash = add_torrent(1, list)->first;
+	w.rebuild_torrent_filter();
+	domain_id d = domains.intern("tracker.example.org", 19);
+	int64_t domain_peers = domains.get(d)->peers;
+	uint64_t leechers = stats.leechers, seeders = stats.seeders;
+	for (size_t i = 0; i < 64; i++) {
+		announce_peer(&w, info_hash, (i % 2 == 0) ? 0 : 1048576, nullptr);
+	}
+
+	rcu_read_guard guard;
+	client_opts_t client_opts = {false, false, false, false, false};
+	params_type params;
+	params["action"] = "add_token_fl";
+	params["info_hash"] = url_encode(info_hash);
+	params["userid"] = "1";
+	params["time"] = std::to_string(time(NULL) + 60);
+	w.update(params, client_opts);
+	const torrent &tor = list.find(info_hash)->second;
+	if (tor.seeders.size() + tor.leechers.size() != 64 || tor.tokened_users.size() != 1 ||
+			domains.get(d)->peers != domain_peers + 64) {
+		check_failed("the torrent to re-add didn't get its peers and token");
+	}
+
+	params.clear();
+	params["action"] = "add_torrent";
+	params["info_hash"] = url_encode(info_hash);
+	params["id"] = "1";
+	params["freetorrent"] = "0";
+	params["doubletorrent"] = "0";
+	w.update(params, client_opts);
+	if (!tor.seeders.empty() || !tor.leechers.empty() || !tor.tokened_users.empty()) {
+		check_failed("re-adding a torrent kept its peers");
+	}
+	if (domains.get(d)->peers != domain_peers || stats.leechers != leechers || stats.seeders != seeders) {
+		check_failed("re-adding a torrent didn't give back its peer counts");
+	}
+
+	unsigned int peers_timeout = conf->get()->peers_timeout;
+	w.reap_peers(time(NULL) + peers_timeout + 120);
+	if (domains.get(d)->peers != domain_peers || stats.leechers != leechers || stats.seeders != seeders) {
+		check_failed("the reaper found peers of a re-added torrent");
+	}
+	db->flush();
+}
+
+// Peers joining and leaving a swarm of 4096, the keys are made up front
+template <typename List> static void peer_churn(size_t n) {
+	static std::vector<std::string> keys;
+	if (keys.empty()) {
+		for (size_t i = 0; i < 8192; i++) {
+			keys.push_back(random_alnum(28));
+		}
+	}
+	List peers;
+	for (size_t i = 0; i < 4096; i++) {
+		peers.emplace(keys[i], peer());
+	}
+	for (size_t i = 0; i < n; i++) {
+		peers.erase(keys[i & 8191]);
+		peers.emplace(keys[(i + 4096) & 8191], peer());
+	}
+	sink += peers.size();
+}
+
+#define SWARM_TABLE_TORRENTS 16384
+#define SWARM_TABLE_PEERS    16   // Per torrent on average
+#define SWARM_TABLE_REQUESTS 8192
+#define SWARM_TABLE_CYCLE    64   // Seconds between wheel visits of a peer
+
+/*
+ * A quarter million peers spread over many torrents, far more than the TLB
+ * covers with 4 KB pages, behind a worker of its own. One is built with
+ * huge pages and one without, both only when their benchmarks run.
+ */
+struct swarm_table : replay_set {
+	torrent_list torrents;
+	worker *work;
+	// Torrent of each re-announce, peers all over the table are replayed
+	std::vector<std::string> info_hashes;
+	// Every peer's hook, moved over from the worker's wheel to one of our own
+	timing_wheel wheel;
+	time_t now;
+	bool due; // The last pass stopped within a second
+
+	swarm_table() : work(nullptr), wheel(0), now(0), due(false) {}
+};
+
+static swarm_table *make_swarm_table(huge_page_mode mode) {
+	size_t huge_before = get_slab_stats().huge;
+	set_huge_page_mode(mode);
+	swarm_table *t = new swarm_table;
+	t->work = new worker(t->torrents, users, domains, blacklist, db, sc);
+	std::vector<std::string> hashes;
+	for (torid_t id = 1; id <= SWARM_TABLE_TORRENTS; id++) {
+		hashes.push_back(add_torrent(id, t->torrents)->first);
+	}
+	t->work->rebuild_torrent_filter();
+
+	// Peers join in random order, so neighbours in memory belong to different swarms
+	size_t peers = SWARM_TABLE_TORRENTS * SWARM_TABLE_PEERS;
+	for (size_t i = 0; i < peers; i++) {
+		const std::string &info_hash = hashes[rng() % hashes.size()];
+		int64_t left = (i % 2 == 0) ? 0 : 1048576;
+		bool replay = i % (peers / SWARM_TABLE_REQUESTS) == 1;
+		announce_peer(t->work, info_hash, left, replay ? t : nullptr);
+		if (replay) {
+			t->info_hashes.push_back(info_hash);
+		}
+		if (i % 16384 == 0) {
+			db->flush();
+		}
+	}
+	db->flush();
+
+	std::vector<wheel_hook*> hooks;
+	for (auto &tor: t->torrents) {
+		for (auto &p: tor.second.seeders) {
+			hooks.push_back(&p.second.expiry);
+		}
+		for (auto &p: tor.second.leechers) {
+			hooks.push_back(&p.second.expiry);
+		}
+	}
+	std::shuffle(hooks.begin(), hooks.end(), rng);
+	for (size_t i = 0; i < hooks.size(); i++) {
+		t->wheel.schedule(hooks[i], 1 + i % SWARM_TABLE_CYCLE);
+	}
+
+	set_huge_page_mode(HUGE_PAGES_OFF);
+	if (mode != HUGE_PAGES_OFF && get_slab_stats().huge == huge_before) {
+		std::cerr << "Huge pages are unavailable, the swarm table uses normal pages" << std::endl;
+	}
+	return t;
+}
+
+static swarm_table &get_swarm_table(bool huge) {
+	static swarm_table *tables[2] = {nullptr, nullptr};
+	if (tables[huge] == nullptr) {
+		tables[huge] = make_swarm_table(huge ? HUGE_PAGES_TRANSPARENT : HUGE_PAGES_OFF);
+	}
+	return *tables[huge];
+}
+
+static void setup() {
+	conf = new settings();
+	opts = new options();
+	conf->set("tracker", "readonly", "true");
+	conf->set("tracker", "clear_peerlists", "false");
+	conf->set("tracker", "syslog_level", "off");
+	conf->set("tracker", "mysql_db", "");
+	init_log();
+
+	db = new database();
+	sc = new site_comm();
+	work = new worker(torrents, users, domains, blacklist, db, sc);
+
+	for (userid_t id = 1; id <= 1000; id++) {
+		std::string passkey = random_alnum(32);
+		passkeys.push_back(passkey);
+		users.insert(std::pair<std::string, user_ptr>(passkey, user_arena::create(id, true, false, false, 0, 0)));
+	}
+	work->rebuild_passkey_table();
+	// Background torrents so lookups hit a realistically sized table
+	for (torid_t id = 1; id <= 100000; id++) {
+		add_torrent(id);
+	}
+	work->rebuild_torrent_filter();
+}
+
+static void run_benchmarks(const std::vector<benchmark> &benchmarks, const std::vector<std::string> &filters, unsigned int repetitions, double scale) {
+	std::cout << std::left << std::setw(36) << "benchmark" << std::right << std::setw(12) << "iterations"
+		<< std::setw(16) << "median ns/op" << std::setw(16) << "min ns/op" << std::endl;
+	for (const benchmark &b: benchmarks) {
+		if (!filters.empty() && std::none_of(filters.begin(), filters.end(),
+				[&b](const std::string &f) { return b.name.find(f) != std::string::npos; })) {
+			continue;
+		}
+		size_t iterations = std::max((size_t)1, (size_t)(b.iterations * scale));
+
+		// One untimed pass to warm caches and let the swarms settle
+		b.run(std::min(iterations, (size_t)1000));
+		db->flush();
+
+		std::vector<double> results;
+		for (unsigned int r = 0; r < repetitions; r++) {
+			auto start = std::chrono::steady_clock::now();
+			b.run(iterations);
+			auto end = std::chrono::steady_clock::now();
+			results.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+			db->flush();
+		}
+		std::sort(results.begin(), results.end());
+		std::cout << std::left << std::setw(36) << b.name << std::right << std::setw(12) << iterations
+			<< std::fixed << std::setprecision(1) << std::setw(16) << results[results.size() / 2]
+			<< std::setw(16) << results.front() << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned int repetitions = 5;
+	double scale = 1.0;
+	std::vector<std::string> filters;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-r") && i < argc - 1) {
+			repetitions = std::max(1, atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "-s") && i < argc - 1) {
+			scale = atof(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			std::cout << "Usage: " << argv[0] << " [-r repetitions] [-s scale] [filter ...]" << std::endl;
+			return 0;
+		} else {
+			filters.push_back(argv[i]);
+		}
+	}
+
+	setup();
+	check_readd_torrent();
+	std::vector<benchmark> benchmarks;
+
+	// Request parsing up to the passkey lookup, which fails
+	{
+		std::string request = announce_request(random_alnum(32), random_bytes(20), "-qB4390-" + random_alnum(12), 0, 50, "");
+		benchmarks.push_back({"work/parse_unknown_passkey", 200000, [request](size_t n) {
+			ip_address ip = client_address("23.1.2.3");
+			for (size_t i = 0; i < n; i++) {
+				client_opts_t client_opts = {false, false, false, false, false};
+				sink += work->work(request, ip, client_opts).size();
+			}
+		}});
+	}
+
+	// Announces for a torrent that isn't registered, as stale clients send
+	{
+		std::string request = announce_request(passkeys[0], random_bytes(20), "-qB4390-" + random_alnum(12), 0, 50, "");
+		benchmarks.push_back({"work/announce_unregistered", 200000, [request](size_t n) {
+			ip_address ip = client_address("23.1.2.3");
+			for (size_t i = 0; i < n; i++) {
+				client_opts_t client_opts = {false, false, false, false, false};
+				sink += work->work(request, ip, client_opts).size();
+			}
+		}});
+	}
+
+	// Full announces from leechers already in the swarm, through work() and
+	// straight into announce() with pre-parsed parameters
+	for (size_t size: {10, 1000, 50000}) {
+		std::shared_ptr<swarm> s = std::make_shared<swarm>(make_swarm(200000 + size, size));
+		std::string suffix = "/" + std::to_string(size);
+		benchmarks.push_back({"work/announce" + suffix, 50000, [s](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				size_t r = i % s->requests.size();
+				client_opts_t client_opts = {false, false, false, false, false};
+				sink += work->work(s->requests[r], s->ips[r], client_opts).size();
+			}
+		}});
+		benchmarks.push_back({"announce" + suffix, 50000, [s](size_t n) {
+			torrent &tor = torrents.find(s->info_hash)->second;
+			domain_id d = domains.intern("tracker.example.org", 19);
+			params_type headers;
+			headers["host"] = "tracker.example.org";
+			headers["user-agent"] = "qBittorrent/4.3.9";
+			for (size_t i = 0; i < n; i++) {
+				rcu_read_guard rcu_guard; // Held by work() in the tracker
+				size_t r = i % s->requests.size();
+				client_opts_t client_opts = {false, false, false, false, false};
+				sink += work->announce(s->requests[r], tor, s->users[r], d, s->params[r], headers, s->ips[r], client_opts).size();
+			}
+		}});
+	}
+
+	// Scrapes of known torrents, a single one and seedbox-sized batches
+	for (size_t count: {1, 10, 100}) {
+		std::vector<std::string> info_hashes;
+		std::list<std::string> encoded;
+		auto tor = torrents.begin();
+		for (size_t i = 0; i < count; i++, ++tor) {
+			info_hashes.push_back(tor->first);
+			encoded.push_back(url_encode(tor->first));
+		}
+		std::string request = scrape_request(passkeys[0], info_hashes);
+		std::string suffix = "/" + std::to_string(count);
+		benchmarks.push_back({"work/scrape" + suffix, 200000 / count, [request](size_t n) {
+			ip_address ip = client_address("23.1.2.3");
+			for (size_t i = 0; i < n; i++) {
+				client_opts_t client_opts = {false, false, false, false, false};
+				sink += work->work(request, ip, client_opts).size();
+			}
+		}});
+		benchmarks.push_back({"scrape" + suffix, 200000 / count, [encoded](size_t n) {
+			params_type headers;
+			for (size_t i = 0; i < n; i++) {
+				client_opts_t client_opts = {false, false, false, false, false};
+				sink += work->scrape(encoded, headers, client_opts).size();
+			}
+		}});
+	}
+
+	// Peers joining with a two hour timeout while the reaper ticks every second
+	benchmarks.push_back({"timing_wheel/churn", 2000000, [](size_t n) {
+		std::vector<wheel_hook> hooks(1 << 16);
+		timing_wheel wheel(0);
+		time_t now = 0;
+		for (size_t i = 0; i < n; i++) {
+			wheel.schedule(&hooks[i & 0xFFFF], now + 7200 + (i % 1800));
+			if ((i & 63) == 63) {
+				wheel.advance(++now, [](wheel_hook *hook) { sink++; return true; });
+			}
+		}
+	}});
+
+	// Passkey lookups with a few users changed since the last rebuild
+	{
+		std::shared_ptr<passkey_table> table = std::make_shared<passkey_table>();
+		table->rebuild(users);
+		for (size_t i = 0; i < 16; i++) {
+			table->set(random_alnum(32), user_arena::create(2000 + i, true, false, false, 0, 0));
+		}
+		benchmarks.push_back({"passkey_table/find", 5000000, [table](size_t n) {
+			rcu_read_guard guard;
+			for (size_t i = 0; i < n; i++) {
+				sink += table->find(passkeys[i % passkeys.size()]) != nullptr;
+			}
+		}});
+	}
+
+	benchmarks.push_back({"peer_list/churn", 2000000, [](size_t n) {
+		peer_churn<peer_list>(n);
+	}});
+	benchmarks.push_back({"peer_list/churn_malloc", 2000000, [](size_t n) {
+		peer_churn<std::unordered_map<std::string, peer>>(n);
+	}});
+
+	// Announces and timing wheel passes all over a big table, with and without huge pages
+	for (bool huge: {false, true}) {
+		std::string suffix = huge ? "/huge" : "/normal";
+		benchmarks.push_back({"swarm_table/announce" + suffix, 200000, [huge](size_t n) {
+			swarm_table &t = get_swarm_table(huge);
+			domain_id d = domains.intern("tracker.example.org", 19);
+			params_type headers;
+			headers["host"] = "tracker.example.org";
+			headers["user-agent"] = "qBittorrent/4.3.9";
+			for (size_t i = 0; i < n; i++) {
+				rcu_read_guard rcu_guard;
+				size_t r = i % t.requests.size();
+				torrent &tor = t.torrents.find(t.info_hashes[r])->second;
+				client_opts_t client_opts = {false, false, false, false, false};
+				sink += t.work->announce(t.requests[r], tor, t.users[r], d, t.params[r], headers, t.ips[r], client_opts).size();
+			}
+		}});
+		// The memory access pattern of the reaper for peers that announced since
+		// they were scheduled: look at the peer and schedule it again. Only the
+		// wheel and the peers are touched, worker::reap_peers with its locking,
+		// slice budget and accounting isn't part of it.
+		benchmarks.push_back({"swarm_table/wheel_pass" + suffix, 1000000, [huge](size_t n) {
+			swarm_table &t = get_swarm_table(huge);
+			size_t visited = 0;
+			while (visited < n) {
+				if (!t.due) {
+					t.now++;
+				}
+				t.due = !t.wheel.advance(t.now, [&](wheel_hook *hook) {
+					const peer &p = static_cast<peer_hook*>(hook)->entry->second;
+					sink += p.last_announced;
+					t.wheel.schedule(hook, t.now + SWARM_TABLE_CYCLE);
+					return ++visited < n;
+				});
+			}
+		}});
+	}
+
+	benchmarks.push_back({"full_scrape/build", 20, [](size_t n) {
+		full_scrape scraper(torrents, db->torrent_list_mutex);
+		for (size_t i = 0; i < n; i++) {
+			scraper.regenerate();
+		}
+	}});
+
+	{
+		static const char hex[] = "0123456789abcdef";
+		std::string info_hash = random_bytes(20);
+		std::string full;
+		for (unsigned char c: info_hash) {
+			full.push_back('%');
+			full.push_back(hex[c >> 4]);
+			full.push_back(hex[c & 0xF]);
+		}
+		std::string mixed = url_encode(info_hash);
+		std::string peer_id = url_encode("-qB4390-" + random_alnum(12));
+		std::string ip = random_ipv4();
+		benchmarks.push_back({"hex_decode/info_hash_encoded", 2000000, [full](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				sink += hex_decode(full).size();
+			}
+		}});
+		benchmarks.push_back({"hex_decode/info_hash_mixed", 2000000, [mixed](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				sink += hex_decode(mixed).size();
+			}
+		}});
+		benchmarks.push_back({"hex_decode/peer_id", 2000000, [peer_id](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				sink += hex_decode(peer_id).size();
+			}
+		}});
+		benchmarks.push_back({"hex_decode/ipv4", 2000000, [ip](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				sink += hex_decode(ip).size();
+			}
+		}});
+		// The strict decoder announces and scrapes use now, on the same input
+		benchmarks.push_back({"hash_decode/info_hash_encoded", 2000000, [full](size_t n) {
+			char out[20];
+			for (size_t i = 0; i < n; i++) {
+				sink += hash_decode(full, out) + out[0];
+			}
+		}});
+		benchmarks.push_back({"hash_decode/info_hash_mixed", 2000000, [mixed](size_t n) {
+			char out[20];
+			for (size_t i = 0; i < n; i++) {
+				sink += hash_decode(mixed, out) + out[0];
+			}
+		}});
+		benchmarks.push_back({"hash_decode/peer_id", 2000000, [peer_id](size_t n) {
+			char out[20];
+			for (size_t i = 0; i < n; i++) {
+				sink += hash_decode(peer_id, out) + out[0];
+			}
+		}});
+	}
+
+	// Client addresses as they arrive in ip parameters and proxy headers
+	{
+		std::string ipv4 = random_ipv4();
+		std::string ipv6 = "2a01:4f8:c17:1b2e::1";
+		std::string ipv6_encoded = "2a01%3A4f8%3Ac17%3A1b2e%3A%3A1";
+		std::string forwarded = ipv4 + ", 10.0.0.1, 172.16.0.1";
+		for (auto const &input: {std::make_pair("parse_ip/ipv4", ipv4), std::make_pair("parse_ip/ipv6", ipv6),
+				std::make_pair("parse_ip/ipv6_encoded", ipv6_encoded)}) {
+			std::string text = input.second;
+			benchmarks.push_back({input.first, 5000000, [text](size_t n) {
+				for (size_t i = 0; i < n; i++) {
+					ip_address addr;
+					sink += parse_ip(text, addr) && addr.is_public;
+				}
+			}});
+		}
+		benchmarks.push_back({"parse_first_hop", 5000000, [forwarded](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				ip_address addr;
+				sink += parse_first_hop(forwarded, addr) && addr.is_public;
+			}
+		}});
+	}
+
+	// A long blacklist of client prefixes against a client that isn't on it
+	{
+		std::shared_ptr<client_blacklist> clients = std::make_shared<client_blacklist>();
+		std::vector<std::string> prefixes;
+		for (int i = 0; i < 1000; i++) {
+			prefixes.push_back("-" + random_alnum(6) + "-");
+		}
+		clients->assign(prefixes);
+		std::string peer_id = "-qB4390-" + random_alnum(12);
+		benchmarks.push_back({"blacklist_match", 5000000, [clients, peer_id](size_t n) {
+			rcu_read_guard rcu_guard;
+			for (size_t i = 0; i < n; i++) {
+				sink += clients->matches(peer_id);
+			}
+		}});
+	}
+
+	{
+		std::string peers = random_bytes(50 * 6);
+		benchmarks.push_back({"bencode_int", 2000000, [](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				sink += worker::bencode_int(i & 0xFFFFF).size();
+			}
+		}});
+		benchmarks.push_back({"bencode_str/key", 2000000, [](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				sink += worker::bencode_str("min interval").size();
+			}
+		}});
+		benchmarks.push_back({"bencode_str/peers", 2000000, [peers](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				sink += worker::bencode_str(peers).size();
+			}
+		}});
+	}
+
+	{
+		std::string announce_body = "d8:completei25e10:downloadedi110e10:incompletei7e8:intervali1825e12:min intervali1800e5:peers"
+			+ std::to_string(50 * 6) + ':' + random_bytes(50 * 6) + 'e';
+		std::string scrape_body;
+		for (int i = 0; i < 100; i++) {
+			scrape_body += "20:" + random_bytes(20) + "d8:completei25e10:downloadedi110e10:incompletei7e11:downloadersi7ee";
+		}
+		benchmarks.push_back({"response/announce", 1000000, [announce_body](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				client_opts_t client_opts = {false, false, false, false, true};
+				sink += response(announce_body, client_opts, 200).size();
+			}
+		}});
+		benchmarks.push_back({"response_writer/announce", 1000000, [](size_t n) {
+			std::string peers = random_bytes(50 * 6);
+			std::string sent;
+			for (size_t i = 0; i < n; i++) {
+				client_opts_t client_opts = {false, false, false, false, true};
+				response_writer &writer = thread_response_writer();
+				writer.begin(client_opts, 200);
+				writer.raw('d');
+				writer.str("complete");
+				writer.integer(25);
+				writer.str("downloaded");
+				writer.integer(110);
+				writer.str("incomplete");
+				writer.integer(7);
+				writer.str("interval");
+				writer.integer(1825);
+				writer.str("min interval");
+				writer.integer(1800);
+				writer.str("peers");
+				writer.str(peers);
+				writer.raw('e');
+				sent = writer.finish();
+				sink += sent.size();
+				writer.recycle(sent);
+			}
+		}});
+		benchmarks.push_back({"response/scrape_gzip", 20000, [scrape_body](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				client_opts_t client_opts = {true, false, false, false, true};
+				sink += response(scrape_body, client_opts, 200).size();
+			}
+		}});
+		benchmarks.push_back({"response_error", 1000000, [](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				client_opts_t client_opts = {false, false, false, false, true};
+				sink += response_error("Unregistered torrent", client_opts).size();
+			}
+		}});
+	}
+
+	{
+		std::string ipv4("\x17\x01\x02\x03", 4);
+		std::string peer_id = "-qB4390-" + random_alnum(12);
+		benchmarks.push_back({"record_user", 1000000, [](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				db->record_user("(1234,1048576,2097152,1048576,2097152)");
+			}
+		}});
+		benchmarks.push_back({"record_torrent", 1000000, [](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				db->record_torrent("(4321,25,7,0,-1048576)");
+			}
+		}});
+		benchmarks.push_back({"record_peer/heavy", 500000, [ipv4, peer_id](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				db->record_peer("1234,4321,1,0,1048576,0,0,1048576,0,1800,1600000000,1600001800,2,", ipv4, "", 51413, peer_id, "qBittorrent/4.3.9");
+			}
+		}});
+		benchmarks.push_back({"record_peer/light", 500000, [peer_id](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				db->record_peer("1234,4321,1800,1600001800,2,", peer_id);
+			}
+		}});
+		benchmarks.push_back({"record_peer_hist", 500000, [ipv4, peer_id](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				db->record_peer_hist("1234,1048576,0,0,0,0,1800", peer_id, ipv4, "", 4321);
+			}
+		}});
+		benchmarks.push_back({"record_snatch", 500000, [ipv4](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				db->record_snatch("1234,4321,1600001800", ipv4, "");
+			}
+		}});
+		benchmarks.push_back({"record_token", 1000000, [](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				db->record_token("(1234,4321,1048576,0)");
+			}
+		}});
+	}
+
+	std::cout << "Radiance v" << PACKAGE_VERSION << " microbenchmarks, seed " << bench_seed
+		<< ", " << repetitions << " repetitions, hash_decode " << hash_decode_impl() << std::endl;
+	run_benchmarks(benchmarks, filters, repetitions, scale);
+	return 0;
+}
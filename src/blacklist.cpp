@@ -0,0 +1,110 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+#include "blacklist.h"
+
+prefix_trie::prefix_trie(const std::vector<std::string> &prefixes) {
+	// Build a pointer free tree first, then lay it out breadth first
+	std::vector<std::map<uint8_t, uint32_t>> children(1);
+	std::vector<bool> terminal(1, false);
+	for (const std::string &prefix: prefixes) {
+		uint32_t cur = 0;
+		for (char c: prefix) {
+			auto child = children[cur].find(static_cast<uint8_t>(c));
+			if (child == children[cur].end()) {
+				uint32_t next = children.size();
+				children[cur][static_cast<uint8_t>(c)] = next;
+				children.emplace_back();
+				terminal.push_back(false);
+				cur = next;
+			} else {
+				cur = child->second;
+			}
+		}
+		terminal[cur] = true;
+	}
+
+	std::vector<uint32_t> order(1, 0);    // Temporary node ids in layout order
+	std::vector<uint32_t> position(children.size()); // Temporary node id -> layout index
+	nodes.reserve(children.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		uint32_t id = order[i];
+		node n;
+		n.first_edge = edges.size();
+		n.edge_count = children[id].size();
+		n.terminal = terminal[id];
+		nodes.push_back(n);
+		for (auto const &child: children[id]) {
+			position[child.second] = order.size();
+			order.push_back(child.second);
+			edges.push_back({child.first, child.second});
+		}
+	}
+	for (edge &e: edges) {
+		e.child = position[e.child];
+	}
+}
+
+bool prefix_trie::matches(const std::string &peer_id) const {
+	const node *cur = &nodes[0];
+	for (size_t i = 0; !cur->terminal; i++) {
+		if (i == peer_id.length()) {
+			return false;
+		}
+		const edge *first = edges.data() + cur->first_edge;
+		const edge *last = first + cur->edge_count;
+		const edge *e = std::lower_bound(first, last, static_cast<uint8_t>(peer_id[i]),
+			[](const edge &candidate, uint8_t byte) { return candidate.byte < byte; });
+		if (e == last || e->byte != static_cast<uint8_t>(peer_id[i])) {
+			return false;
+		}
+		cur = &nodes[e->child];
+	}
+	return true;
+}
+
+client_blacklist::client_blacklist() : trie(new prefix_trie(entries)) {}
+
+// Callers hold write_lock
+void client_blacklist::publish() {
+	trie.publish(new prefix_trie(entries));
+}
+
+void client_blacklist::assign(const std::vector<std::string> &peer_ids) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	entries = peer_ids;
+	publish();
+}
+
+void client_blacklist::add(const std::string &peer_id) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	entries.push_back(peer_id);
+	publish();
+}
+
+void client_blacklist::remove(const std::string &peer_id) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	auto entry = std::find(entries.begin(), entries.end(), peer_id);
+	if (entry != entries.end()) {
+		entries.erase(entry);
+		publish();
+	}
+}
+
+void client_blacklist::replace(const std::string &old_peer_id, const std::string &new_peer_id) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	auto entry = std::find(entries.begin(), entries.end(), old_peer_id);
+	if (entry != entries.end()) {
+		entries.erase(entry);
+	}
+	entries.push_back(new_peer_id);
+	publish();
+}
+
+size_t client_blacklist::size() {
+	std::lock_guard<std::mutex> lock(write_lock);
+	return entries.size();
+}
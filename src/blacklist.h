@@ -0,0 +1,52 @@
+#ifndef RADIANCE_BLACKLIST_H
+#define RADIANCE_BLACKLIST_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+
+#include "rcu.h"
+
+// Immutable prefix trie over the blacklisted peer_id prefixes
+class prefix_trie {
+	private:
+		struct node {
+			uint32_t first_edge; // Edges of a node are contiguous and sorted by byte
+			uint16_t edge_count;
+			bool terminal;       // A blacklisted prefix ends here
+		};
+		struct edge {
+			uint8_t byte;
+			uint32_t child;
+		};
+		std::vector<node> nodes;
+		std::vector<edge> edges;
+	public:
+		prefix_trie(const std::vector<std::string> &prefixes);
+		bool matches(const std::string &peer_id) const;
+};
+
+/*
+ * The client blacklist. Announces check peer ids against a trie compiled
+ * from the entries, which is rebuilt and published on every change, so
+ * matching takes no lock and only costs a few byte comparisons per
+ * character of the longest matching prefix.
+ */
+class client_blacklist {
+	private:
+		std::mutex write_lock;
+		std::vector<std::string> entries;
+		rcu_ptr<prefix_trie> trie;
+		void publish();
+	public:
+		client_blacklist();
+		// Takes no lock, checks against whichever trie was last published
+		inline bool matches(const std::string &peer_id) const { return trie->matches(peer_id); }
+		void assign(const std::vector<std::string> &peer_ids);
+		void add(const std::string &peer_id);
+		void remove(const std::string &peer_id);
+		void replace(const std::string &old_peer_id, const std::string &new_peer_id);
+		size_t size();
+};
+#endif
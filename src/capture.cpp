@@ -0,0 +1,144 @@
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+
+#include "radiance.h"
+#include "capture.h"
+#include "config.h"
+#include "logger.h"
+
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+
+static void put_le(uint8_t *out, uint64_t value, unsigned int bytes) {
+	for (unsigned int i = 0; i < bytes; i++) {
+		out[i] = static_cast<uint8_t>(value >> (8 * i));
+	}
+}
+
+static uint64_t get_le(const uint8_t *in, unsigned int bytes) {
+	uint64_t value = 0;
+	for (unsigned int i = 0; i < bytes; i++) {
+		value |= static_cast<uint64_t>(in[i]) << (8 * i);
+	}
+	return value;
+}
+
+request_capture::request_capture() : file(NULL), size(0), full(false) {
+	load_config();
+	open();
+}
+
+request_capture::~request_capture() {
+	close();
+}
+
+void request_capture::load_config() {
+	rcu_read_guard guard;
+	const tracker_config *cfg = conf->get();
+	path     = cfg->capture_path;
+	max_size = static_cast<uint64_t>(cfg->capture_max_size) << 20;
+}
+
+void request_capture::reload_config() {
+	std::string old_path = path;
+	uint64_t old_max_size = max_size;
+	load_config();
+	if (path != old_path || max_size != old_max_size) {
+		full = false;
+	} else if (file != NULL || full) {
+		return; // A file that reached capture_max_size stays closed until the limit or path changes
+	}
+	close();
+	open();
+}
+
+void request_capture::open() {
+	if (path.empty() || path == "off") {
+		return;
+	}
+	file = fopen(path.c_str(), "ab");
+	if (file == NULL) {
+		syslog(error) << "Could not open capture file " << path << ": " << strerror(errno);
+		return;
+	}
+	setvbuf(file, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	if (size == 0) {
+		fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LENGTH, file);
+		size = CAPTURE_MAGIC_LENGTH;
+	}
+	syslog(info) << "Capturing requests to " << path;
+}
+
+void request_capture::close() {
+	if (file != NULL) {
+		fclose(file);
+		file = NULL;
+		syslog(info) << "Stopped capturing requests to " << path;
+	}
+}
+
+void request_capture::write(const std::string &request, const ip_address &client_addr) {
+	uint8_t head[8 + 4 + 1 + 16];
+	size_t head_length = 8 + 4 + 1 + client_addr.length();
+	uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	put_le(head, now, 8);
+	put_le(head + 8, request.length(), 4);
+	head[12] = client_addr.version;
+	memcpy(head + 13, client_addr.bytes, client_addr.length());
+
+	if (fwrite(head, 1, head_length, file) != head_length ||
+	    fwrite(request.data(), 1, request.length(), file) != request.length()) {
+		syslog(error) << "Writing to capture file " << path << " failed: " << strerror(errno);
+		close();
+		return;
+	}
+	size += head_length + request.length();
+	if (max_size != 0 && size >= max_size) {
+		syslog(warning) << "Capture file " << path << " reached capture_max_size";
+		close();
+		full = true;
+	}
+}
+
+capture_reader::capture_reader(const std::string &path) : valid(false) {
+	file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return;
+	}
+	char magic[CAPTURE_MAGIC_LENGTH];
+	valid = fread(magic, 1, CAPTURE_MAGIC_LENGTH, file) == CAPTURE_MAGIC_LENGTH
+		&& memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LENGTH) == 0;
+}
+
+capture_reader::~capture_reader() {
+	if (file != NULL) {
+		fclose(file);
+	}
+}
+
+bool capture_reader::next(captured_request &req) {
+	if (!valid) {
+		return false;
+	}
+	uint8_t head[8 + 4 + 1];
+	if (fread(head, 1, sizeof(head), file) != sizeof(head)) {
+		return false;
+	}
+	req.timestamp = get_le(head, 8);
+	size_t length = get_le(head + 8, 4);
+	uint8_t ip_ver = head[12] == 4 || head[12] == 6 ? head[12] : 0;
+
+	uint8_t address[16];
+	size_t address_length = ip_ver == 4 ? 4 : (ip_ver == 6 ? 16 : 0);
+	req.request.resize(length);
+	if ((address_length != 0 && fread(address, 1, address_length, file) != address_length) ||
+	    (length != 0 && fread(&req.request[0], 1, length, file) != length)) {
+		valid = false; // Truncated record, most likely the tracker was still writing
+		return false;
+	}
+	req.client_addr.assign(ip_ver, address);
+	return true;
+}
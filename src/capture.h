@@ -0,0 +1,61 @@
+#ifndef RADIANCE_CAPTURE_H
+#define RADIANCE_CAPTURE_H
+
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+
+#include "ip_address.h"
+
+/*
+ * Request capture log, replayed offline by radiance-replay.
+ *
+ * The file starts with the 8 byte magic "RADCAP01", followed by one record
+ * per request, all integers little-endian:
+ *   uint64  microseconds since the epoch when the request was complete
+ *   uint32  request length
+ *   uint8   client address family: 4, 6 or 0 for unix sockets
+ *   4/16/0  client address in network order, IPv4-mapped IPv6 stored as IPv4
+ *   ...     the raw request as read from the socket
+ */
+#define CAPTURE_MAGIC "RADCAP01"
+#define CAPTURE_MAGIC_LENGTH 8
+
+struct captured_request {
+	uint64_t timestamp;
+	ip_address client_addr; // Version 0 for unix sockets
+	std::string request;
+};
+
+// Appends requests to the file named by capture_path, owned by connection_mother
+class request_capture {
+	private:
+		FILE *file;
+		std::string path;
+		uint64_t max_size;
+		uint64_t size;
+		bool full; // Closed for reaching max_size
+		void load_config();
+		void open();
+		void close();
+
+	public:
+		request_capture();
+		~request_capture();
+		void reload_config();
+		void write(const std::string &request, const ip_address &client_addr);
+		const inline bool enabled() const { return file != NULL; }
+};
+
+class capture_reader {
+	private:
+		FILE *file;
+		bool valid;
+
+	public:
+		explicit capture_reader(const std::string &path);
+		~capture_reader();
+		bool next(captured_request &req);
+		const inline bool is_valid() const { return valid; }
+};
+#endif
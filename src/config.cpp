@@ -2,6 +2,7 @@
 #include <fstream>
 #include <string>
 #include <map>
+#include <algorithm>
 #include "config.h"
 #include "misc_functions.h"
 
@@ -55,78 +56,17 @@ void confval::set(const std::string &value) {
 	}
 }
 
-settings::settings() {
-	init();
-	dummy_setting = new confval(); // Safety value to use if we're accessing nonexistent settings
-}
-settings::~settings() {
-	delete dummy_setting;
-}
+settings::settings() : current(new tracker_config) {}
 
 options::options() {
 	init();
 	dummy_setting = new confval(); // Safety value to use if we're accessing nonexistent settings
+	update_promos();
 }
 options::~options() {
 	delete dummy_setting;
 }
 
-void settings::init() {
-	// Internal stuff
-	add("listen_port", 2710u);
-	add("listen_host", "*");
-	add("listen_path", "");
-	add("max_connections", 1024u);
-	add("max_middlemen", 20000u);
-	add("max_read_buffer", 4096u);
-	add("connection_timeout", 10u);
-	add("keepalive_timeout", 0u);
-	add("real_ip_header", "");
-
-	// Tracker requests
-	add("announce_interval", 1800u);
-	add("max_request_size", 4096u);
-	add("numwant_limit", 50u);
-
-	// Timers
-	add("del_reason_lifetime", 86400u);
-	add("peers_timeout", 7200u);
-	add("reap_peers_interval", 1800u);
-	add("schedule_interval", 3u);
-
-	// MySQL
-	add("mysql_db", "gazelle");
-	add("mysql_host", "localhost");
-	add("mysql_port", 3306u);
-	add("mysql_path", "");
-	add("mysql_username", "");
-	add("mysql_password", "");
-	add("mysql_connections", 8u);
-	add("mysql_timeout", 30u);
-	add("mysql_retry", 5u);
-
-	// Site communication
-	add("site_host", "127.0.0.1");
-	add("site_port", 80u);
-	add("site_path", "");
-	add("site_password",   "00000000000000000000000000000000");
-	add("report_password", "00000000000000000000000000000000");
-
-	// General Control
-	add("readonly",        false);
-	add("anonymous",       false);
-	add("anonymous_password", "00000000000000000000000000000000");
-	add("clear_peerlists",  true);
-	add("load_peerlists",  false);
-	add("peers_history",    true);
-	add("files_peers",      true);
-	add("snatched_history", true);
-	add("daemonize",       false);
-	add("syslog_path",     "off");
-	add("syslog_level",    "info");
-	add("pid_file",        "./radiance.pid");
-}
-
 void options::init() {
 	add("SitewideFreeleechMode",        "off");
 	add("SitewideFreeleechStartTime",   0u);
@@ -137,6 +77,41 @@ void options::init() {
 	add("EnableIPv6Tracker",            false);
 }
 
+static promo_window get_promo_window(const std::string &mode, time_t start, time_t end) {
+	promo_window window;
+	if (mode == "perma") {
+		window.mode = promo_window::PERMA;
+	} else if (mode == "timed") {
+		window.mode = promo_window::TIMED;
+	} else {
+		window.mode = promo_window::OFF;
+	}
+	window.start = start;
+	window.end = end;
+	return window;
+}
+
+void options::set(const std::string &section_name, const std::string &setting_name, const std::string &value) {
+	std::lock_guard<std::mutex> lock(set_lock);
+	config::set(section_name, setting_name, value);
+	update_promos();
+}
+
+// Only publishes a new snapshot if something changed, load_site_options sets every option in turn
+void options::update_promos() {
+	site_promos *next = new site_promos;
+	next->freeleech  = get_promo_window(get_str("SitewideFreeleechMode"), get_time("SitewideFreeleechStartTime"), get_time("SitewideFreeleechEndTime"));
+	next->doubleseed = get_promo_window(get_str("SitewideDoubleseedMode"), get_time("SitewideDoubleseedStartTime"), get_time("SitewideDoubleseedEndTime"));
+	next->ipv6_tracker = get_bool("EnableIPv6Tracker");
+
+	const site_promos *cur = promos.get();
+	if (cur != nullptr && cur->freeleech == next->freeleech && cur->doubleseed == next->doubleseed && cur->ipv6_tracker == next->ipv6_tracker) {
+		delete next;
+		return;
+	}
+	promos.publish(next);
+}
+
 confval * config::get(const std::string &setting_name) {
 	const auto setting = settings.find(setting_name);
 	if (setting == settings.end()) {
@@ -167,12 +142,31 @@ void config::set(const std::string &section_name, const std::string &setting_nam
 	get(setting_name)->set(value);
 }
 
-void settings::load(const std::string &conf_file_path, std::istream &conf_file) {
-	load(conf_file);
-	add("conf_file_path", conf_file_path.c_str());
+static void parse_value(bool &setting, const std::string &value) {
+	setting = value == "1" || value == "true" || value == "yes";
 }
 
-void settings::load(std::istream &conf_file) {
+static void parse_value(uint32_t &setting, const std::string &value) {
+	setting = strtoint32(value);
+}
+
+static void parse_value(std::string &setting, const std::string &value) {
+	setting = value;
+}
+
+void settings::assign(tracker_config &cfg, const std::string &section_name, const std::string &setting_name, const std::string &value) {
+	if (section_name != "tracker") return;
+#define X(type, name, default_value) \
+	if (setting_name == #name) { \
+		parse_value(cfg.name, value); \
+		return; \
+	}
+	TRACKER_SETTINGS(X)
+#undef X
+	std::cerr << "WARNING: Unrecognized setting '" << setting_name << "'" << std::endl;
+}
+
+void settings::parse(tracker_config &cfg, std::istream &conf_file) {
 	std::string line;
 	std::string section = "global";
 	while (getline(conf_file, line)) {
@@ -184,19 +178,52 @@ void settings::load(std::istream &conf_file) {
 			} else if ((pos = line.find('=')) != std::string::npos) {
 				std::string key(trim(line.substr(0, pos)));
 				std::string value(trim(line.substr(pos + 1)));
-				set(section, key, value);
+				assign(cfg, section, key, value);
 			}
 		}
 	}
 }
 
+void settings::publish(tracker_config *next) {
+	// Request headers are stored in lower case
+	std::transform(next->real_ip_header.begin(), next->real_ip_header.end(), next->real_ip_header.begin(), ::tolower);
+	current.publish(next);
+}
+
+// Writers hold write_lock, so the snapshot they copy can't be retired under them
+void settings::load(std::istream &conf_file) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	tracker_config *next = new tracker_config(*current.get());
+	parse(*next, conf_file);
+	publish(next);
+}
+
+void settings::load(const std::string &conf_file_path, std::istream &conf_file) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	tracker_config *next = new tracker_config(*current.get());
+	parse(*next, conf_file);
+	next->conf_file_path = conf_file_path;
+	publish(next);
+}
+
+// Settings missing from the file go back to their defaults
 void settings::reload() {
-	const std::string conf_file_path(get_str("conf_file_path"));
+	std::lock_guard<std::mutex> lock(write_lock);
+	const std::string conf_file_path(current.get()->conf_file_path);
 	std::ifstream conf_file(conf_file_path);
 	if (conf_file.fail()) {
 		std::cerr << "Config file '" << conf_file_path << "' couldn't be opened" << std::endl;
 	} else {
-		init();
-		load(conf_file);
+		tracker_config *next = new tracker_config;
+		parse(*next, conf_file);
+		next->conf_file_path = conf_file_path;
+		publish(next);
 	}
 }
+
+void settings::set(const std::string &section_name, const std::string &setting_name, const std::string &value) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	tracker_config *next = new tracker_config(*current.get());
+	assign(*next, section_name, setting_name, value);
+	publish(next);
+}
@@ -6,6 +6,9 @@
 #include <time.h>
 #include <iosfwd>
 #include <map>
+#include <mutex>
+
+#include "rcu.h"
 
 class confval {
 	private:
@@ -45,23 +48,133 @@ class config {
 		void set(const std::string &section_name, const std::string &setting_name, const std::string &value);
 };
 
-class settings : public config {
+// Every setting from the [tracker] section of the config file: type, name, default
+#define TRACKER_SETTINGS(X) \
+	/* Internal stuff */ \
+	X(uint32_t,    listen_port,         2710) \
+	X(std::string, listen_host,         "*") \
+	X(std::string, listen_path,         "") \
+	X(uint32_t,    max_connections,     1024) \
+	X(uint32_t,    max_middlemen,       20000) \
+	X(uint32_t,    max_read_buffer,     4096) \
+	X(uint32_t,    connection_timeout,  10) \
+	X(uint32_t,    keepalive_timeout,   0) \
+	X(std::string, real_ip_header,      "") \
+	/* Tracker requests */ \
+	X(uint32_t,    announce_interval,   1800) \
+	X(uint32_t,    max_request_size,    4096) \
+	X(uint32_t,    numwant_limit,       50) \
+	/* Timers */ \
+	X(uint32_t,    del_reason_lifetime, 86400) \
+	X(uint32_t,    peers_timeout,       7200) \
+	X(uint32_t,    reap_peers_interval, 1800) \
+	X(uint32_t,    reap_slice_size,     1000) \
+	X(uint32_t,    reap_slice_time,     2000) \
+	X(uint32_t,    schedule_interval,   3) \
+	X(uint32_t,    full_scrape_interval, 0) \
+	X(std::string, huge_pages,          "off") \
+	/* Where each thread role runs, see thread_role.h */ \
+	X(std::string, event_loop_cpus,     "") \
+	X(std::string, db_flush_cpus,       "") \
+	X(std::string, reaper_cpus,         "") \
+	X(std::string, reload_cpus,         "") \
+	X(std::string, site_comm_cpus,      "") \
+	X(std::string, full_scrape_cpus,    "") \
+	X(uint32_t,    maintenance_nice,    10) \
+	/* MySQL */ \
+	X(std::string, mysql_db,            "gazelle") \
+	X(std::string, mysql_host,          "localhost") \
+	X(uint32_t,    mysql_port,          3306) \
+	X(std::string, mysql_path,          "") \
+	X(std::string, mysql_username,      "") \
+	X(std::string, mysql_password,      "") \
+	X(uint32_t,    mysql_connections,   8) \
+	X(uint32_t,    mysql_timeout,       30) \
+	X(uint32_t,    mysql_retry,         5) \
+	/* Site communication */ \
+	X(std::string, site_host,           "127.0.0.1") \
+	X(uint32_t,    site_port,           80) \
+	X(std::string, site_path,           "") \
+	X(std::string, site_password,       "00000000000000000000000000000000") \
+	X(std::string, report_password,     "00000000000000000000000000000000") \
+	/* General Control */ \
+	X(bool,        readonly,            false) \
+	X(bool,        anonymous,           false) \
+	X(std::string, anonymous_password,  "00000000000000000000000000000000") \
+	X(bool,        clear_peerlists,     true) \
+	X(bool,        load_peerlists,      false) \
+	X(bool,        peers_history,       true) \
+	X(bool,        files_peers,         true) \
+	X(bool,        snatched_history,    true) \
+	X(bool,        daemonize,           false) \
+	X(std::string, syslog_path,         "off") \
+	X(std::string, syslog_level,        "info") \
+	X(std::string, pid_file,            "./radiance.pid") \
+	/* Request capture for radiance-replay */ \
+	X(std::string, capture_path,        "off") \
+	X(uint32_t,    capture_max_size,    1024)
+
+// An immutable snapshot of the tracker settings, misspelled names don't compile
+struct tracker_config {
+#define X(type, name, value) type name = value;
+	TRACKER_SETTINGS(X)
+#undef X
+	std::string conf_file_path;
+};
+
+/*
+ * Readers call get() and use the snapshot until their rcu_read_guard ends.
+ * load(), reload() and set() build a new snapshot and publish it, so nobody
+ * ever sees a half loaded config.
+ */
+class settings {
 	private:
-	    void init();
+		rcu_ptr<tracker_config> current;
+		std::mutex write_lock;
+		static void parse(tracker_config &cfg, std::istream &conf_file);
+		static void assign(tracker_config &cfg, const std::string &section_name, const std::string &setting_name, const std::string &value);
+		void publish(tracker_config *next);
 	public:
 		settings();
-		~settings();
+		inline const tracker_config * get() const { return current.get(); }
 		void load(std::istream &conf_file);
 		void load(const std::string &conf_file_path, std::istream &conf_file);
 		void reload();
+		void set(const std::string &section_name, const std::string &setting_name, const std::string &value);
+};
+
+// One sitewide freeleech or doubleseed setting from the site options
+struct promo_window {
+	enum { OFF, TIMED, PERMA } mode;
+	time_t start;
+	time_t end;
+	const inline bool active(time_t now) const {
+		return mode == PERMA || (mode == TIMED && start <= now && end >= now);
+	}
+	const inline bool operator==(const promo_window &other) const {
+		return mode == other.mode && start == other.start && end == other.end;
+	}
+};
+
+// What announces need from the site options, rebuilt whenever one of them changes
+struct site_promos {
+	promo_window freeleech;
+	promo_window doubleseed;
+	bool ipv6_tracker;
 };
 
 class options : public config{
 	private:
 	    void init();
+		void update_promos();
+		std::mutex set_lock;
+		rcu_ptr<site_promos> promos;
 	public:
 		options();
 		~options();
+		void set(const std::string &section_name, const std::string &setting_name, const std::string &value);
+		// Whatever set() last published, the promo windows still need checking against now
+		const inline site_promos * get_promos() const { return promos.get(); }
 };
 
 template <typename T> void config::add(const std::string &setting_name, T value) {
@@ -11,8 +11,10 @@
 #include "logger.h"
 #include "database.h"
 #include "user.h"
+#include "domain.h"
 #include "misc_functions.h"
 #include "config.h"
+#include "thread_role.h"
 
 #define DB_LOCK_TIMEOUT 50
 
@@ -101,17 +103,27 @@ unsigned int dbConnectionPool::max_idle_time() {
 }
 
 void dbConnectionPool::load_config() {
-	mysql_db          = conf->get_str("mysql_db");
-	mysql_host        = conf->get_str("mysql_host");
-	mysql_username    = conf->get_str("mysql_username");
-	mysql_password    = conf->get_str("mysql_password");
-	mysql_port        = conf->get_uint("mysql_port");
-	mysql_connections = conf->get_uint("mysql_connections");
-	mysql_timeout     = conf->get_uint("mysql_timeout");
-	mysql_retry       = conf->get_uint("mysql_retry");
+	rcu_read_guard guard;
+	const tracker_config *cfg = conf->get();
+	mysql_db          = cfg->mysql_db;
+	mysql_host        = cfg->mysql_host;
+	mysql_username    = cfg->mysql_username;
+	mysql_password    = cfg->mysql_password;
+	mysql_port        = cfg->mysql_port;
+	mysql_connections = cfg->mysql_connections;
+	mysql_timeout     = cfg->mysql_timeout;
+	mysql_retry       = cfg->mysql_retry;
 }
 
-database::database() : u_active(false), t_active(false), p_active(false), s_active(false), h_active(false), tok_active(false) {
+database::database() :
+	user_volume{0, 0}, torrent_volume{0, 0}, peer_volume{0, 0}, peer_hist_volume{0, 0}, snatch_volume{0, 0}, token_volume{0, 0}, queued_bytes(0),
+	u_active(false), t_active(false), p_active(false), s_active(false), h_active(false), tok_active(false),
+	user_buffer_lock("user_buffer"), torrent_buffer_lock("torrent_buffer"), peer_buffer_lock("peer_buffer"),
+	peer_hist_buffer_lock("peer_hist_buffer"), snatch_buffer_lock("snatch_buffer"), token_buffer_lock("token_buffer"),
+	user_queue_lock("user_queue"), torrent_queue_lock("torrent_queue"), peer_queue_lock("peer_queue"),
+	peer_hist_queue_lock("peer_hist_queue"), snatch_queue_lock("snatch_queue"), token_queue_lock("token_queue"),
+	torrent_list_mutex("torrent_list"), user_list_mutex("user_list")
+{
 	load_config();
 	pool = new dbConnectionPool;
 
@@ -128,13 +140,15 @@ void database::shutdown() {
 }
 
 void database::load_config() {
-	readonly         = conf->get_bool("readonly");
-	clear_peerlists  = conf->get_bool("clear_peerlists");
-	load_peerlists   = conf->get_bool("load_peerlists");
-	peers_history    = conf->get_bool("peers_history");
-	snatched_history = conf->get_bool("snatched_history");
-	files_peers      = conf->get_bool("files_peers");
-	mysql_retry      = conf->get_uint("mysql_retry");
+	rcu_read_guard guard;
+	const tracker_config *cfg = conf->get();
+	readonly         = cfg->readonly;
+	clear_peerlists  = cfg->clear_peerlists;
+	load_peerlists   = cfg->load_peerlists;
+	peers_history    = cfg->peers_history;
+	snatched_history = cfg->snatched_history;
+	files_peers      = cfg->files_peers;
+	mysql_retry      = cfg->mysql_retry;
 }
 
 void database::reload_config() {
@@ -190,7 +204,7 @@ void database::load_site_options() {
 	mysqlpp::Connection::thread_end();
 }
 
-void database::load_torrents(torrent_list &torrents) {
+void database::load_torrents(torrent_list &torrents, domain_list &domains) {
 	mysqlpp::Connection::thread_start();
 	syslog(trace) << "Connecting to DB to load torrents";
 	mysqlpp::ScopedConnection conn(*pool, true);
@@ -199,7 +213,7 @@ void database::load_torrents(torrent_list &torrents) {
 		mysqlpp::StoreQueryResult res = query.store();
 		std::unordered_set<std::string> cur_keys;
 		size_t num_rows = res.num_rows();
-		std::lock_guard<std::mutex> tl_lock(torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(torrent_list_mutex);
 		if (torrents.empty()) {
 			torrents.reserve(num_rows * 1.05); // Reserve 5% extra space to prevent rehashing
 		} else {
@@ -264,11 +278,20 @@ void database::load_torrents(torrent_list &torrents) {
 				torrent &tor = it->second;
 				stats.leechers -= tor.leechers.size();
 				stats.seeders -= tor.seeders.size();
+				rcu_read_guard guard;
 				for (auto &p: tor.leechers) {
-					p.second.user->decr_leeching();
+					user_ptr u = user_arena::get(p.second.user);
+					if (u != nullptr) {
+						u->decr_leeching();
+					}
+					domains.peers_changed(p.second.domain, -1);
 				}
 				for (auto &p: tor.seeders) {
-					p.second.user->decr_seeding();
+					user_ptr u = user_arena::get(p.second.user);
+					if (u != nullptr) {
+						u->decr_seeding();
+					}
+					domains.peers_changed(p.second.domain, -1);
 				}
 				torrents.erase(it);
 			}
@@ -282,7 +305,7 @@ void database::load_torrents(torrent_list &torrents) {
 	mysqlpp::Connection::thread_end();
 }
 
-void database::load_users(user_list &users) {
+void database::load_users(user_list &users, std::vector<user_ptr> &removed) {
 	mysqlpp::Connection::thread_start();
 	syslog(trace) << "Connecting to DB to load users";
 	mysqlpp::ScopedConnection conn(*pool, true);
@@ -291,7 +314,7 @@ void database::load_users(user_list &users) {
 		mysqlpp::StoreQueryResult res = query.store();
 		size_t num_rows = res.num_rows();
 		std::unordered_set<std::string> cur_keys;
-		std::lock_guard<std::mutex> ul_lock(user_list_mutex);
+		std::lock_guard<tracker_mutex> ul_lock(user_list_mutex);
 		if (users.empty()) {
 			users.reserve(num_rows * 1.05); // Reserve 5% extra space to prevent rehashing
 		} else {
@@ -307,10 +330,11 @@ void database::load_users(user_list &users) {
 			bool track_ipv6 = res[i][4];
 			mysqlpp::DateTime pfl = res[i][5];
 			mysqlpp::DateTime pds = res[i][6];
-			user_ptr tmp_user = std::make_shared<user>(res[i][0], res[i][1], protect_ip, track_ipv6, pfl, pds);
-			auto it = users.insert(std::pair<std::string, user_ptr>(passkey, tmp_user));
-			if (!it.second) {
-				user_ptr &u = (it.first)->second;
+			auto it = users.find(passkey);
+			if (it == users.end()) {
+				users.insert(std::pair<std::string, user_ptr>(passkey, user_arena::create(res[i][0], res[i][1], protect_ip, track_ipv6, pfl, pds)));
+			} else {
+				user_ptr u = it->second;
 				u->set_personalfreeleech(pfl);
 				u->set_personaldoubleseed(pds);
 				u->set_leechstatus(res[i][1]);
@@ -325,6 +349,7 @@ void database::load_users(user_list &users) {
 			auto it = users.find(passkey);
 			if (it != users.end()) {
 				it->second->set_deleted(true);
+				removed.push_back(it->second);
 				users.erase(it);
 			}
 		}
@@ -353,7 +378,7 @@ void database::load_seeders(torrent_list &torrents, user_list &users) {
 	mysqlpp::ScopedConnection conn(*pool, true);
 	try {
 		for (auto &torrent_it: torrents) {
-			torrent torrent = torrent_it.second;
+			torrent &torrent = torrent_it.second;
 			mysqlpp::Query query = conn->query();
 			query << "SELECT um.torrent_pass, xfu.peer_id, xfu.port, xfu.ipv4, xfu.ipv6, xfu.uploaded,"
 			      << " xfu.downloaded, xfu.remaining, xfu.corrupt, xfu.announced, xfu.ctime, xfu.mtime"
@@ -364,8 +389,8 @@ void database::load_seeders(torrent_list &torrents, user_list &users) {
 			mysqlpp::StoreQueryResult res = query.store();
 			num_rows = res.num_rows();
 			num_seeders += num_rows;
-			std::lock_guard<std::mutex> ul_lock(user_list_mutex);
-			std::lock_guard<std::mutex> tl_lock(torrent_list_mutex);
+			std::lock_guard<tracker_mutex> ul_lock(user_list_mutex);
+			std::lock_guard<tracker_mutex> tl_lock(torrent_list_mutex);
 			if (torrent.seeders.empty()) {
 				torrent.seeders.reserve(num_rows * 1.05); // Reserve 5% extra space to prevent rehashing
 			} else {
@@ -396,8 +421,8 @@ void database::load_seeders(torrent_list &torrents, user_list &users) {
 				}
 
 				p = &peer_it->second;
-				p->user = u;
-				p->user->incr_seeding();
+				p->user = u->ref();
+				u->incr_seeding();
 				stats.seeders++;
 
 				p->port			= res[i][2];
@@ -451,7 +476,7 @@ void database::load_leechers(torrent_list &torrents, user_list &users) {
 	mysqlpp::ScopedConnection conn(*pool, true);
 	try {
 		for (auto &torrent_it: torrents) {
-			torrent torrent = torrent_it.second;
+			torrent &torrent = torrent_it.second;
 			mysqlpp::Query query = conn->query();
 			query << "SELECT um.torrent_pass, xfu.peer_id, xfu.port, xfu.ipv4, xfu.ipv6, xfu.uploaded,"
 			      << " xfu.downloaded, xfu.remaining, xfu.corrupt, xfu.announced, xfu.ctime, xfu.mtime"
@@ -462,8 +487,8 @@ void database::load_leechers(torrent_list &torrents, user_list &users) {
 			mysqlpp::StoreQueryResult res = query.store();
 			num_rows = res.num_rows();
 			num_leechers += num_rows;
-			std::lock_guard<std::mutex> ul_lock(user_list_mutex);
-			std::lock_guard<std::mutex> tl_lock(torrent_list_mutex);
+			std::lock_guard<tracker_mutex> ul_lock(user_list_mutex);
+			std::lock_guard<tracker_mutex> tl_lock(torrent_list_mutex);
 			if (torrent.leechers.empty()) {
 				torrent.leechers.reserve(num_rows * 1.05); // Reserve 5% extra space to prevent rehashing
 			} else {
@@ -494,8 +519,8 @@ void database::load_leechers(torrent_list &torrents, user_list &users) {
 				}
 
 				p = &peer_it->second;
-				p->user = u;
-				p->user->incr_leeching();
+				p->user = u->ref();
+				u->incr_leeching();
 				stats.leechers++;
 
 				p->port			= res[i][2];
@@ -562,7 +587,7 @@ void database::load_tokens(torrent_list &torrents) {
 		mysqlpp::Query query = conn->query("SELECT us.UserID, us.FreeLeech, us.DoubleSeed, t.info_hash FROM users_slots AS us JOIN torrents AS t ON t.ID = us.TorrentID WHERE FreeLeech >= NOW() OR DoubleSeed >= NOW();");
 		mysqlpp::StoreQueryResult res = query.store();
 		size_t num_rows = res.num_rows();
-		std::lock_guard<std::mutex> tl_lock(torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(torrent_list_mutex);
 		for (size_t i = 0; i < num_rows; i++) {
 			std::string info_hash;
 			res[i][3].to_string(info_hash);
@@ -589,7 +614,7 @@ void database::load_tokens(torrent_list &torrents) {
 }
 
 
-void database::load_blacklist(std::vector<std::string> &blacklist) {
+void database::load_blacklist(client_blacklist &blacklist) {
 	mysqlpp::Connection::thread_start();
 	syslog(trace) << "Connecting to DB to load blacklist";
 	mysqlpp::ScopedConnection conn(*pool, true);
@@ -597,18 +622,18 @@ void database::load_blacklist(std::vector<std::string> &blacklist) {
 		mysqlpp::Query query = conn->query("SELECT peer_id FROM xbt_client_blacklist;");
 		mysqlpp::StoreQueryResult res = query.store();
 		size_t num_rows = res.num_rows();
-		std::lock_guard<std::mutex> wl_lock(blacklist_mutex);
-		blacklist.clear();
+		std::vector<std::string> peer_ids;
 		for (size_t i = 0; i<num_rows; i++) {
 			std::string peer_id;
 			res[i][0].to_string(peer_id);
-			blacklist.push_back(peer_id);
+			peer_ids.push_back(peer_id);
 		}
+		blacklist.assign(peer_ids);
 	} catch (const mysqlpp::BadQuery &er) {
 		syslog(error) << "Query error in load_blacklist: " << er.what();
 		return;
 	}
-	if (blacklist.empty()) {
+	if (blacklist.size() == 0) {
 		syslog(info) << "Assuming no blacklist desired, disabling";
 	} else {
 		syslog(trace) << "Loaded " << blacklist.size() << " clients into the blacklist";
@@ -617,78 +642,182 @@ void database::load_blacklist(std::vector<std::string> &blacklist) {
 	mysqlpp::Connection::thread_end();
 }
 
+// Quoted and escaped like mysqlpp::quote without a connection, which uses mysql_escape_string
+struct sql_quoted {
+	const std::string &value;
+};
+
+static inline sql_quoted quoted(const std::string &value) {
+	return {value};
+}
+
+static string_builder & operator<<(string_builder &out, const sql_quoted &q) {
+	std::string &buffer = out.str();
+	buffer.reserve(buffer.size() + 2 * q.value.size() + 2);
+	buffer += '\'';
+	for (char c: q.value) {
+		switch (c) {
+			case '\0':   buffer += "\\0"; break;
+			case '\n':   buffer += "\\n"; break;
+			case '\r':   buffer += "\\r"; break;
+			case '\\':   buffer += "\\\\"; break;
+			case '\'':   buffer += "\\'"; break;
+			case '"':    buffer += "\\\""; break;
+			case '\032': buffer += "\\Z"; break;
+			default:     buffer += c;
+		}
+	}
+	buffer += '\'';
+	return out;
+}
+
 void database::record_token(const std::string &record) {
-	std::lock_guard<std::mutex> buffer_lock(token_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(token_buffer_lock);
 	if (!update_token_buffer.empty()) {
 		update_token_buffer += ",";
 	}
 	update_token_buffer += record;
+	token_volume.records++;
+	token_volume.bytes += record.length();
 }
 
 void database::record_user(const std::string &record) {
-	std::lock_guard<std::mutex> buffer_lock(user_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(user_buffer_lock);
 	if (!update_user_buffer.empty()) {
 		update_user_buffer += ",";
 	}
 	update_user_buffer += record;
+	user_volume.records++;
+	user_volume.bytes += record.length();
 }
 
 void database::record_torrent(const std::string &record) {
-	std::lock_guard<std::mutex> buffer_lock(torrent_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(torrent_buffer_lock);
 	if (!update_torrent_buffer.empty()) {
 		update_torrent_buffer += ",";
 	}
 	update_torrent_buffer += record;
+	torrent_volume.records++;
+	torrent_volume.bytes += record.length();
 }
 
 void database::record_peer(const std::string &record, const std::string &ipv4, const std::string &ipv6, int port, const std::string &peer_id, const std::string &useragent) {
-	std::lock_guard<std::mutex> buffer_lock(peer_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(peer_buffer_lock);
 	if (!update_peer_heavy_buffer.empty()) {
 		update_peer_heavy_buffer += ",";
 	}
-	// Null query for quoting
-	mysqlpp::Query query(NULL);
-	query << '(' << record << mysqlpp::quote << ipv4 << ','
-				<< mysqlpp::quote << ipv6 << ',' << port << ','
-				<< mysqlpp::quote << peer_id << ','
-				<< mysqlpp::quote << useragent << ')';
-
-	update_peer_heavy_buffer += query.str();
+	string_builder query;
+	query << '(' << record << quoted(ipv4) << ','
+				<< quoted(ipv6) << ',' << port << ','
+				<< quoted(peer_id) << ','
+				<< quoted(useragent) << ')';
+
+	const std::string &record_str = query.str();
+	update_peer_heavy_buffer += record_str;
+	peer_volume.records++;
+	peer_volume.bytes += record_str.length();
 }
 void database::record_peer(const std::string &record, const std::string &peer_id) {
-	std::lock_guard<std::mutex> buffer_lock(peer_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(peer_buffer_lock);
 	if (!update_peer_light_buffer.empty()) {
 		update_peer_light_buffer += ",";
 	}
-	// Null query for quoting
-	mysqlpp::Query query(NULL);
-	query << '(' << record << mysqlpp::quote << peer_id << ')';
+	string_builder query;
+	query << '(' << record << quoted(peer_id) << ')';
 
-	update_peer_light_buffer += query.str();
+	const std::string &record_str = query.str();
+	update_peer_light_buffer += record_str;
+	peer_volume.records++;
+	peer_volume.bytes += record_str.length();
 }
 
 void database::record_peer_hist(const std::string &record, const std::string &peer_id, const std::string &ipv4, const std::string &ipv6, int tid){
-	std::lock_guard<std::mutex> buffer_lock(peer_hist_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(peer_hist_buffer_lock);
 	if (!update_peer_hist_buffer.empty()) {
 		update_peer_hist_buffer += ",";
 	}
-	// Null query for quoting
-	mysqlpp::Query query(NULL);
-	query << '(' << record << ',' << mysqlpp::quote << peer_id << ','
-				<< mysqlpp::quote << ipv4 << ',' << mysqlpp::quote << ipv6 << ','
+	string_builder query;
+	query << '(' << record << ',' << quoted(peer_id) << ','
+				<< quoted(ipv4) << ',' << quoted(ipv6) << ','
 				<< tid << ',' << time(NULL) << ')';
-	update_peer_hist_buffer += query.str();
+	const std::string &record_str = query.str();
+	update_peer_hist_buffer += record_str;
+	peer_hist_volume.records++;
+	peer_hist_volume.bytes += record_str.length();
 }
 
 void database::record_snatch(const std::string &record, const std::string &ipv4, const std::string &ipv6) {
-	std::lock_guard<std::mutex> buffer_lock(snatch_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(snatch_buffer_lock);
 	if (!update_snatch_buffer.empty()) {
 		update_snatch_buffer += ",";
 	}
-	// Null query for quoting
-	mysqlpp::Query query(NULL);
-	query << '(' << record << ',' << mysqlpp::quote << ipv4 << ',' << mysqlpp::quote << ipv6 << ')';
-	update_snatch_buffer += query.str();
+	string_builder query;
+	query << '(' << record << ',' << quoted(ipv4) << ',' << quoted(ipv6) << ')';
+	const std::string &record_str = query.str();
+	update_snatch_buffer += record_str;
+	snatch_volume.records++;
+	snatch_volume.bytes += record_str.length();
+}
+
+std::map<std::string, record_volume> database::get_record_volume() {
+	std::map<std::string, record_volume> volume;
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(user_buffer_lock);
+		volume["user"] = user_volume;
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(torrent_buffer_lock);
+		volume["torrent"] = torrent_volume;
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(peer_buffer_lock);
+		volume["peer"] = peer_volume;
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(peer_hist_buffer_lock);
+		volume["peer_hist"] = peer_hist_volume;
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(snatch_buffer_lock);
+		volume["snatch"] = snatch_volume;
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(token_buffer_lock);
+		volume["token"] = token_volume;
+	}
+	return volume;
+}
+
+void database::get_memory_usage(std::vector<memory_usage> &usage) {
+	memory_usage buffers = {"update buffers", 7, 0, 0, 0}; // One per record type, peers have two
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(user_buffer_lock);
+		buffers.strings += update_user_buffer.capacity();
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(torrent_buffer_lock);
+		buffers.strings += update_torrent_buffer.capacity();
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(peer_buffer_lock);
+		buffers.strings += update_peer_heavy_buffer.capacity() + update_peer_light_buffer.capacity();
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(peer_hist_buffer_lock);
+		buffers.strings += update_peer_hist_buffer.capacity();
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(snatch_buffer_lock);
+		buffers.strings += update_snatch_buffer.capacity();
+	}
+	{
+		std::lock_guard<tracker_mutex> buffer_lock(token_buffer_lock);
+		buffers.strings += update_token_buffer.capacity();
+	}
+	usage.push_back(buffers);
+
+	uint64_t queued = stats.user_queue + stats.torrent_queue + stats.peer_queue + stats.peer_hist_queue + stats.snatch_queue + stats.token_queue;
+	usage.push_back({"flush queues", queued, 0, queued * sizeof(std::string), queued_bytes});
 }
 
 bool database::all_clear() {
@@ -705,13 +834,13 @@ void database::flush() {
 }
 
 void database::flush_users() {
-	std::lock_guard<std::mutex> buffer_lock(user_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(user_buffer_lock);
 	if (readonly) {
 		update_user_buffer.clear();
 		return;
 	}
 	std::string sql;
-	std::lock_guard<std::mutex> queue_lock(user_queue_lock);
+	std::lock_guard<tracker_mutex> queue_lock(user_queue_lock);
 	size_t qsize = user_queue.size();
 	if (qsize > 0) {
 		syslog(trace) << "User flush queue size: " << qsize << ", next query length: " << user_queue.front().size();
@@ -729,22 +858,23 @@ void database::flush_users() {
 		" UploadedDaily = UploadedDaily + VALUES(UploadedDaily)," +
 		" DownloadedDaily = DownloadedDaily + VALUES(DownloadedDaily)";
 	user_queue.push(sql);
+	queued_bytes += sql.size();
 	stats.user_queue++;
 	update_user_buffer.clear();
 	if (!u_active) {
-		std::thread thread(&database::do_flush, this, std::ref(u_active), std::ref(user_queue), std::ref(user_queue_lock), std::ref(stats.user_queue), "user");
+		std::thread thread(&database::do_flush, this, std::ref(u_active), std::ref(user_queue), std::ref(user_queue_lock), std::ref(stats.user_queue), "user", "db-user");
 		thread.detach();
 	}
 }
 
 void database::flush_torrents() {
-	std::lock_guard<std::mutex> buffer_lock(torrent_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(torrent_buffer_lock);
 	if (readonly) {
 		update_torrent_buffer.clear();
 		return;
 	}
 	std::string sql;
-	std::lock_guard<std::mutex> queue_lock(torrent_queue_lock);
+	std::lock_guard<tracker_mutex> queue_lock(torrent_queue_lock);
 	size_t qsize = torrent_queue.size();
 	if (qsize > 0) {
 		syslog(trace) << "Torrent flush queue size: " << qsize << ", next query length: " << torrent_queue.front().size();
@@ -760,26 +890,28 @@ void database::flush_torrents() {
 		"Snatched=Snatched+VALUES(Snatched), Balance=VALUES(Balance), last_action = " +
 		"IF(VALUES(Seeders) > 0, NOW(), last_action)";
 	torrent_queue.push(sql);
+	queued_bytes += sql.size();
 	stats.torrent_queue++;
 	update_torrent_buffer.clear();
 	sql.clear();
 	sql = "DELETE FROM torrents WHERE info_hash = ''";
 	stats.torrent_queue++;
 	torrent_queue.push(sql);
+	queued_bytes += sql.size();
 	if (!t_active) {
-		std::thread thread(&database::do_flush, this, std::ref(t_active), std::ref(torrent_queue), std::ref(torrent_queue_lock), std::ref(stats.torrent_queue), "torrent");
+		std::thread thread(&database::do_flush, this, std::ref(t_active), std::ref(torrent_queue), std::ref(torrent_queue_lock), std::ref(stats.torrent_queue), "torrent", "db-torrent");
 		thread.detach();
 	}
 }
 
 void database::flush_snatches() {
-	std::lock_guard<std::mutex> buffer_lock(snatch_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(snatch_buffer_lock);
 	if (readonly || !snatched_history) {
 		update_snatch_buffer.clear();
 		return;
 	}
 	std::string sql;
-	std::lock_guard<std::mutex> queue_lock(snatch_queue_lock);
+	std::lock_guard<tracker_mutex> queue_lock(snatch_queue_lock);
 	size_t qsize = snatch_queue.size();
 	if (qsize > 0) {
 		syslog(trace) << "Snatch flush queue size: " << qsize << ", next query length: " << snatch_queue.front().size();
@@ -790,23 +922,24 @@ void database::flush_snatches() {
 	sql = "INSERT INTO xbt_snatched (uid, fid, tstamp, ipv4, ipv6) VALUES " + update_snatch_buffer +
 	" ON DUPLICATE KEY UPDATE tstamp=VALUES(tstamp), ipv4=VALUES(ipv4), ipv6=VALUES(ipv6)";
 	snatch_queue.push(sql);
+	queued_bytes += sql.size();
 	stats.snatch_queue++;
 	update_snatch_buffer.clear();
 	if (!s_active) {
-		std::thread thread(&database::do_flush, this, std::ref(s_active), std::ref(snatch_queue), std::ref(snatch_queue_lock), std::ref(stats.snatch_queue), "snatch");
+		std::thread thread(&database::do_flush, this, std::ref(s_active), std::ref(snatch_queue), std::ref(snatch_queue_lock), std::ref(stats.snatch_queue), "snatch", "db-snatch");
 		thread.detach();
 	}
 }
 
 void database::flush_peers() {
-	std::lock_guard<std::mutex> buffer_lock(peer_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(peer_buffer_lock);
 	if (readonly || !files_peers) {
 		update_peer_light_buffer.clear();
 		update_peer_heavy_buffer.clear();
 		return;
 	}
 	std::string sql;
-	std::lock_guard<std::mutex> queue_lock(peer_queue_lock);
+	std::lock_guard<tracker_mutex> queue_lock(peer_queue_lock);
 	size_t qsize = peer_queue.size();
 	if (qsize > 0) {
 		syslog(trace) << "Peer flush queue size: " << qsize << ", next query length: " << peer_queue.front().size();
@@ -823,6 +956,7 @@ void database::flush_peers() {
 		// xfu will be messed up if the light query inserts a new row,
 		// but that's better than an oom crash
 		if (qsize >= 1000) {
+			queued_bytes -= peer_queue.front().size();
 			peer_queue.pop();
 			stats.peer_queue--;
 		}
@@ -834,6 +968,7 @@ void database::flush_peers() {
 					"corrupt=VALUES(corrupt), timespent=VALUES(timespent), " +
 					"announced=VALUES(announced), mtime=VALUES(mtime), port=VALUES(port)";
 		peer_queue.push(sql);
+		queued_bytes += sql.size();
 		stats.peer_queue++;
 		update_peer_heavy_buffer.clear();
 		sql.clear();
@@ -841,6 +976,7 @@ void database::flush_peers() {
 	if (!update_peer_light_buffer.empty()) {
 		// See comment above
 		if (qsize >= 1000) {
+			queued_bytes -= peer_queue.front().size();
 			peer_queue.pop();
 			stats.peer_queue--;
 		}
@@ -849,47 +985,49 @@ void database::flush_peers() {
 					" ON DUPLICATE KEY UPDATE upspeed=0, downspeed=0, timespent=VALUES(timespent), " +
 					"announced=VALUES(announced), mtime=VALUES(mtime)";
 		peer_queue.push(sql);
+		queued_bytes += sql.size();
 		stats.peer_queue++;
 		update_peer_light_buffer.clear();
 		sql.clear();
 	}
 
 	if (!p_active) {
-		std::thread thread(&database::do_flush, this, std::ref(p_active), std::ref(peer_queue), std::ref(peer_queue_lock), std::ref(stats.peer_queue), "peer");
+		std::thread thread(&database::do_flush, this, std::ref(p_active), std::ref(peer_queue), std::ref(peer_queue_lock), std::ref(stats.peer_queue), "peer", "db-peer");
 		thread.detach();
 	}
 }
 
 void database::flush_peer_hist() {
-	std::lock_guard<std::mutex> buffer_lock(peer_hist_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(peer_hist_buffer_lock);
 	if (readonly || !peers_history) {
 		update_peer_hist_buffer.clear();
 		return;
 	}
 	std::string sql;
-	std::lock_guard<std::mutex> queue_lock(peer_hist_queue_lock);
+	std::lock_guard<tracker_mutex> queue_lock(peer_hist_queue_lock);
 	if (update_peer_hist_buffer.empty()) {
 		return;
 	}
 
 	sql = "INSERT INTO xbt_peers_history (uid, downloaded, remaining, uploaded, upspeed, downspeed, timespent, peer_id, ipv4, ipv6, fid, mtime) VALUES " + update_peer_hist_buffer;
 	peer_hist_queue.push(sql);
+	queued_bytes += sql.size();
 	stats.peer_hist_queue++;
 	update_peer_hist_buffer.clear();
 	if (!h_active) {
-		std::thread thread(&database::do_flush, this, std::ref(h_active), std::ref(peer_hist_queue), std::ref(peer_hist_queue_lock), std::ref(stats.peer_hist_queue), "peers history");
+		std::thread thread(&database::do_flush, this, std::ref(h_active), std::ref(peer_hist_queue), std::ref(peer_hist_queue_lock), std::ref(stats.peer_hist_queue), "peers history", "db-peer-hist");
 		thread.detach();
 	}
 }
 
 void database::flush_tokens() {
-	std::lock_guard<std::mutex> buffer_lock(token_buffer_lock);
+	std::lock_guard<tracker_mutex> buffer_lock(token_buffer_lock);
 	if (readonly) {
 		update_token_buffer.clear();
 		return;
 	}
 	std::string sql;
-	std::lock_guard<std::mutex> queue_lock(token_queue_lock);
+	std::lock_guard<tracker_mutex> queue_lock(token_queue_lock);
 	size_t qsize = token_queue.size();
 	if (qsize > 0) {
 		syslog(trace) << "Token flush queue size: " << qsize << ", next query length: " << token_queue.front().size();
@@ -900,15 +1038,17 @@ void database::flush_tokens() {
 	sql = "INSERT INTO users_freeleeches (UserID, TorrentID, Downloaded, Uploaded) VALUES " + update_token_buffer +
 				" ON DUPLICATE KEY UPDATE Downloaded = Downloaded + VALUES(Downloaded), Uploaded = Uploaded + VALUES(Uploaded)";
 	token_queue.push(sql);
+	queued_bytes += sql.size();
 	stats.token_queue++;
 	update_token_buffer.clear();
 	if (!tok_active) {
-		std::thread thread(&database::do_flush, this, std::ref(tok_active), std::ref(token_queue), std::ref(token_queue_lock), std::ref(stats.token_queue), "token");
+		std::thread thread(&database::do_flush, this, std::ref(tok_active), std::ref(token_queue), std::ref(token_queue_lock), std::ref(stats.token_queue), "token", "db-token");
 		thread.detach();
 	}
 }
 
-void database::do_flush(bool &active, std::queue<std::string> &queue, std::mutex &lock, std::atomic<uint64_t> &queue_size, const std::string queue_name) {
+void database::do_flush(bool &active, std::queue<std::string> &queue, tracker_mutex &lock, std::atomic<uint64_t> &queue_size, const std::string queue_name, const char *thread_name) {
+	enter_thread_role(ROLE_DB_FLUSH, thread_name);
 	active = true;
 	mysqlpp::Connection::thread_start();
 	try {
@@ -930,7 +1070,8 @@ void database::do_flush(bool &active, std::queue<std::string> &queue, std::mutex
 					std::this_thread::sleep_for(std::chrono::seconds(mysql_retry));
 					continue;
 				} else {
-					std::lock_guard<std::mutex> local_lock(lock);
+					std::lock_guard<tracker_mutex> local_lock(lock);
+					queued_bytes -= sql.size();
 					queue.pop();
 					queue_size--;
 				}
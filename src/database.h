@@ -6,8 +6,14 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
+#include <map>
+#include <vector>
 #include <mutex>
 
+#include "tracker_mutex.h"
+#include "blacklist.h"
+#include "memory.h"
+
 class dbConnectionPool : public mysqlpp::ConnectionPool {
 	private:
 		void load_config();
@@ -31,6 +37,12 @@ class dbConnectionPool : public mysqlpp::ConnectionPool {
 		unsigned int max_idle_time();
 };
 
+// Rows and bytes appended to one of the update buffers since startup
+struct record_volume {
+	uint64_t records;
+	uint64_t bytes;
+};
+
 class database {
 	private:
 		dbConnectionPool* pool;
@@ -42,12 +54,21 @@ class database {
 		std::string update_snatch_buffer;
 		std::string update_token_buffer;
 
+		// Guarded by the matching buffer lock
+		record_volume user_volume;
+		record_volume torrent_volume;
+		record_volume peer_volume;
+		record_volume peer_hist_volume;
+		record_volume snatch_volume;
+		record_volume token_volume;
+
 		std::queue<std::string> user_queue;
 		std::queue<std::string> torrent_queue;
 		std::queue<std::string> peer_queue;
 		std::queue<std::string> peer_hist_queue;
 		std::queue<std::string> snatch_queue;
 		std::queue<std::string> token_queue;
+		std::atomic<uint64_t> queued_bytes; // Statements in all the queues
 
 		bool u_active, t_active, p_active, s_active, h_active, tok_active;
 		bool readonly, load_peerlists, clear_peerlists, peers_history, snatched_history, files_peers;
@@ -55,19 +76,19 @@ class database {
 
 		// These locks prevent more than one thread from reading/writing the buffers.
 		// These should be held for the minimum time possible.
-		std::mutex user_buffer_lock;
-		std::mutex torrent_buffer_lock;
-		std::mutex peer_buffer_lock;
-		std::mutex peer_hist_buffer_lock;
-		std::mutex snatch_buffer_lock;
-		std::mutex token_buffer_lock;
-
-		std::mutex user_queue_lock;
-		std::mutex torrent_queue_lock;
-		std::mutex peer_queue_lock;
-		std::mutex peer_hist_queue_lock;
-		std::mutex snatch_queue_lock;
-		std::mutex token_queue_lock;
+		tracker_mutex user_buffer_lock;
+		tracker_mutex torrent_buffer_lock;
+		tracker_mutex peer_buffer_lock;
+		tracker_mutex peer_hist_buffer_lock;
+		tracker_mutex snatch_buffer_lock;
+		tracker_mutex token_buffer_lock;
+
+		tracker_mutex user_queue_lock;
+		tracker_mutex torrent_queue_lock;
+		tracker_mutex peer_queue_lock;
+		tracker_mutex peer_hist_queue_lock;
+		tracker_mutex snatch_queue_lock;
+		tracker_mutex token_queue_lock;
 
 		void load_config();
 
@@ -78,7 +99,7 @@ class database {
 		void flush_peers();
 		void flush_peer_hist();
 		void flush_tokens();
-		void do_flush(bool &active, std::queue<std::string> &queue, std::mutex &lock, std::atomic<uint64_t> &queue_size, const std::string queue_name);
+		void do_flush(bool &active, std::queue<std::string> &queue, tracker_mutex &lock, std::atomic<uint64_t> &queue_size, const std::string queue_name, const char *thread_name);
 		void clear_peer_data();
 
 		peer_list::iterator add_peer(peer_list &peer_list, const std::string &peer_id);
@@ -89,13 +110,15 @@ class database {
 		void shutdown();
 		void reload_config();
 		void load_site_options();
-		void load_torrents(torrent_list &torrents);
+		void load_torrents(torrent_list &torrents, domain_list &domains);
 		void load_tokens(torrent_list &torrents);
-		void load_users(user_list &users);
+		// Users gone from the database are moved to removed, for the caller
+		// to release once nothing can find them any more
+		void load_users(user_list &users, std::vector<user_ptr> &removed);
 		void load_peers(torrent_list &torrents, user_list &users);
 		void load_seeders(torrent_list &torrents, user_list &users);
 		void load_leechers(torrent_list &torrents, user_list &users);
-		void load_blacklist(std::vector<std::string> &blacklist);
+		void load_blacklist(client_blacklist &blacklist);
 
 		void record_user(const std::string &record); // (id,uploaded_change,downloaded_change)
 		void record_torrent(const std::string &record); // (id,seeders,leechers,snatched_change,balance)
@@ -107,11 +130,11 @@ class database {
 
 		void flush();
 		bool all_clear();
+		std::map<std::string, record_volume> get_record_volume();
+		void get_memory_usage(std::vector<memory_usage> &usage);
 
-		std::mutex torrent_list_mutex;
-		std::mutex user_list_mutex;
-		std::mutex domain_list_mutex;
-		std::mutex blacklist_mutex;
+		tracker_mutex torrent_list_mutex;
+		tracker_mutex user_list_mutex;
 };
 
 #pragma GCC visibility pop
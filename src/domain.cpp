@@ -1,6 +1,79 @@
 #include <string>
 #include <atomic>
+#include <mutex>
+#include <cstring>
 
 #include "domain.h"
+#include "logger.h"
 
-domain::domain(std::string host) : host(host) {}
+#define DOMAIN_CACHE_SIZE 64 // Per thread, direct mapped
+
+struct domain_cache_entry {
+	uint64_t instance; // 0 for an empty entry
+	domain_id id;
+	std::string host;
+};
+
+static thread_local domain_cache_entry domain_cache[DOMAIN_CACHE_SIZE];
+static std::atomic<uint64_t> next_instance(1);
+
+// FNV-1a, only used to pick a cache entry
+static inline uint32_t host_hash(const char *host, size_t length) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ static_cast<uint8_t>(host[i])) * 16777619u;
+	}
+	return hash;
+}
+
+domain::domain(const std::string &host) : host(host), peers(0) {}
+
+domain_list::domain_list() : mutex("domain_list"), domains(new std::atomic<domain*>[DOMAIN_MAX]), count(0), full(false), instance(next_instance++) {
+	for (size_t i = 0; i < DOMAIN_MAX; i++) {
+		domains[i].store(nullptr, std::memory_order_relaxed);
+	}
+	std::lock_guard<tracker_mutex> lock(mutex);
+	add("unknown");
+}
+
+domain_list::~domain_list() {
+	for (domain_id id = 0; id < count; id++) {
+		delete domains[id].load();
+	}
+}
+
+// Called with the mutex held
+domain_id domain_list::add(const std::string &host) {
+	auto it = ids.find(host);
+	if (it != ids.end()) {
+		return it->second;
+	}
+	domain_id id = count.load(std::memory_order_relaxed);
+	if (id == DOMAIN_MAX) {
+		if (!full) {
+			syslog(warning) << "Too many announce domains, counting the rest as unknown";
+			full = true;
+		}
+		return 0;
+	}
+	domains[id].store(new domain(host), std::memory_order_release);
+	ids.emplace(host, id);
+	count.store(id + 1, std::memory_order_release);
+	return id;
+}
+
+domain_id domain_list::intern(const char *host, size_t length) {
+	domain_cache_entry &entry = domain_cache[host_hash(host, length) & (DOMAIN_CACHE_SIZE - 1)];
+	if (entry.instance == instance && entry.host.length() == length && memcmp(entry.host.data(), host, length) == 0) {
+		return entry.id;
+	}
+	domain_id id;
+	{
+		std::lock_guard<tracker_mutex> lock(mutex);
+		id = add(std::string(host, length));
+	}
+	entry.instance = instance;
+	entry.id = id;
+	entry.host.assign(host, length);
+	return id;
+}
@@ -1,9 +1,54 @@
 #ifndef DOMAIN_H
 #define DOMAIN_H
 
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include "radiance.h"
+#include "tracker_mutex.h"
+
+// Host headers are client supplied, hosts past this many all count as "unknown"
+#define DOMAIN_MAX 4096
+
 class domain {
 	public:
 		std::string host;
-		domain(std::string host);
+		std::atomic<int64_t> peers; // Peers that first announced through it
+		domain(const std::string &host);
+};
+
+/*
+ * Announce domains interned into small ids, which is what peers store.
+ * Every thread keeps a small cache of the hosts it has seen, so a known
+ * host is turned into its id without locking or allocating. The table
+ * itself is only locked to add a host. Domains are never removed, so get()
+ * needs no lock either. Id 0 is "unknown".
+ */
+class domain_list {
+	private:
+		tracker_mutex mutex;
+		std::unique_ptr<std::atomic<domain*>[]> domains;
+		std::atomic<domain_id> count;
+		std::unordered_map<std::string, domain_id> ids; // With the mutex held
+		bool full;
+		uint64_t instance; // Tells the thread caches of different tables apart
+
+		domain_id add(const std::string &host);
+
+	public:
+		domain_list();
+		~domain_list();
+		domain_list(const domain_list&) = delete;
+		domain_list& operator=(const domain_list&) = delete;
+
+		domain_id intern(const char *host, size_t length);
+		inline domain_id size() const { return count.load(std::memory_order_acquire); }
+		inline domain * get(domain_id id) const { return domains[id].load(std::memory_order_acquire); }
+		inline void peers_changed(domain_id id, int64_t delta) {
+			if (delta != 0 && id != DOMAIN_NONE) {
+				get(id)->peers.fetch_add(delta, std::memory_order_relaxed);
+			}
+		}
 };
 #endif
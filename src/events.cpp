@@ -1,4 +1,5 @@
 #include <cerrno>
+#include <chrono>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/resource.h>
@@ -15,6 +16,7 @@
 #include "config.h"
 #include "logger.h"
 #include "misc_functions.h"
+#include "metrics.h"
 
 // Define the connection mother (first half) and connection middlemen (second half)
 
@@ -45,14 +47,16 @@ connection_mother::connection_mother(worker * worker_obj, site_comm * sc_obj, sc
 }
 
 void connection_mother::load_config() {
-	listen_port	       = conf->get_uint("listen_port");
-	listen_hosts       = split(conf->get_str("listen_host"), ' ');
-	max_connections    = conf->get_uint("max_connections");
-	max_middlemen      = conf->get_uint("max_middlemen");
-	connection_timeout = conf->get_uint("connection_timeout");
-	keepalive_timeout  = conf->get_uint("keepalive_timeout");
-	max_read_buffer    = conf->get_uint("max_read_buffer");
-	max_request_size   = conf->get_uint("max_request_size");
+	rcu_read_guard guard;
+	const tracker_config *cfg = conf->get();
+	listen_port	       = cfg->listen_port;
+	listen_hosts       = split(cfg->listen_host, ' ');
+	max_connections    = cfg->max_connections;
+	max_middlemen      = cfg->max_middlemen;
+	connection_timeout = cfg->connection_timeout;
+	keepalive_timeout  = cfg->keepalive_timeout;
+	max_read_buffer    = cfg->max_read_buffer;
+	max_request_size   = cfg->max_request_size;
 }
 
 void connection_mother::reload_config() {
@@ -62,6 +66,7 @@ void connection_mother::reload_config() {
 	std::vector<int> old_listen_sockets = listen_sockets;
 	load_config();
 	set_rlimit();
+	capture.reload_config();
 	if (old_listen_port != listen_port) {
 		syslog(info) << "Changing listen port from " << old_listen_port << " to " << listen_port;
 
@@ -341,7 +346,11 @@ int connection_mother::create_unix_server(const std::string &path)
 
 int connection_mother::create_listen_socket()
 {
-	std::string listen_host_conf = conf->get_str("listen_host");
+	std::string listen_host_conf;
+	{
+		rcu_read_guard guard;
+		listen_host_conf = conf->get()->listen_host;
+	}
 	if (trim(listen_host_conf).empty() || listen_host_conf == "*") {
 		if (create_tcp_server(listen_port, "*") == RESULT_ERR) {
 			return RESULT_ERR;
@@ -410,13 +419,16 @@ connection_mother::~connection_mother()
 connection_middleman::connection_middleman(int &listen_socket, worker * new_work, connection_mother * mother_arg) :
 	written(0), mother(mother_arg), work(new_work)
 {
-	client_opts = {false, false, false, false};
-	connect_sock = accept(listen_socket, NULL, NULL);
+	client_opts = {false, false, false, false, false};
+	struct sockaddr_storage peer_addr;
+	socklen_t addr_len = sizeof(peer_addr);
+	connect_sock = accept(listen_socket, (struct sockaddr *) &peer_addr, &addr_len);
 	if (connect_sock == -1) {
 		syslog(error) << "Accept failed, errno " << errno << ": " << strerror(errno);
 		delete this;
 		return;
 	}
+	known_family = client_addr.assign(peer_addr);
 
 	// Set non-blocking
 	int flags = fcntl(connect_sock, F_GETFL);
@@ -463,6 +475,8 @@ void connection_middleman::handle_read(ev::io &watcher, int events_flags) {
 		read_event.stop();
 		client_opts.gzip = false;
 		client_opts.html = false;
+		client_opts.json = false;
+		client_opts.openmetrics = false;
 //		This causes nginx persistent connections to
 //		close early, was this intentional?
 //		client_opts.http_close = true;
@@ -470,38 +484,18 @@ void connection_middleman::handle_read(ev::io &watcher, int events_flags) {
 		if (request_size > mother->max_request_size) {
 			shutdown(connect_sock, SHUT_RD);
 			response = response_error("GET string too long", client_opts);
+		} else if (!known_family) {
+			shutdown(connect_sock, SHUT_RD);
+			response = response_error("Unknown Domain Socket", client_opts);
 		} else {
-			struct sockaddr_storage client_addr;
-			char ip[INET6_ADDRSTRLEN];
-			socklen_t addr_len = sizeof(client_addr);
-			uint16_t ip_ver = 0;
-			getpeername(connect_sock, (struct sockaddr *) &client_addr, &addr_len);
-			std::string ip_str;
-			if(client_addr.ss_family == AF_INET) {
-				struct sockaddr_in *s = (struct sockaddr_in *)&client_addr;
-				ip_ver = 4;
-				inet_ntop(AF_INET, (void*)&(s->sin_addr), ip, sizeof(ip));
-				ip_str = ip;
-			} else if (client_addr.ss_family == AF_INET6) {
-				struct sockaddr_in6 *s6 = (struct sockaddr_in6 *)&client_addr;
-				ip_ver = 6;
-				inet_ntop(AF_INET6, (void*)&(s6->sin6_addr), ip, sizeof(ip));
-				ip_str = ip;
-
-				// Handle IPv6-mapped IPv4
-				if (ip_str.substr(0, 7) == "::ffff:") {
-					ip_ver = 4;
-					ip_str = ip_str.substr(7);
-			}
-			} else if (client_addr.ss_family == AF_UNIX) {
-				ip_str = ""; // Empty, should be taken from additional headers
-			} else {
-				shutdown(connect_sock, SHUT_RD);
-				response = response_error("Unknown Domain Socket", client_opts);
+			if (mother->capture.enabled()) {
+				mother->capture.write(request, client_addr);
 			}
 
 			//--- CALL WORKER
-			response = work->work(request, ip_str, ip_ver, client_opts);
+			auto start_time = std::chrono::steady_clock::now();
+			response = work->work(request, client_addr, client_opts);
+			request_latency.observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count());
 			request.clear();
 			request_size = 0;
 		}
@@ -523,6 +517,8 @@ void connection_middleman::handle_write(ev::io &watcher, int events_flags) {
 	written += ret;
 	if (written == response.size()) {
 		write_event.stop();
+		// Hand the buffer back so the next response doesn't allocate
+		thread_response_writer().recycle(response);
 		if (client_opts.http_close) {
 			timeout_event.stop();
 			delete this;
@@ -530,7 +526,6 @@ void connection_middleman::handle_write(ev::io &watcher, int events_flags) {
 		}
 		timeout_event.again();
 		read_event.start();
-		response.clear();
 		written = 0;
 	}
 }
@@ -542,3 +537,14 @@ void connection_middleman::handle_timeout(ev::timer &watcher, int events_flags)
 	write_event.stop();
 	delete this;
 }
+
+memory_usage connection_memory_usage() {
+	uint64_t open = stats.open_connections;
+	uint64_t read_buffer;
+	{
+		rcu_read_guard guard;
+		read_buffer = conf->get()->max_read_buffer;
+	}
+	// Responses are short lived and handed back to the writer once sent, not counted
+	return {"connections", open, 0, open * malloc_size(sizeof(connection_middleman)), open * string_heap(read_buffer)};
+}
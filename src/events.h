@@ -11,6 +11,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "capture.h"
+#include "ip_address.h"
+#include "memory.h"
+
 #define RESULT_OK 0
 #define RESULT_ERR -1
 
@@ -68,6 +72,7 @@ class connection_mother {
 		unsigned int keepalive_timeout;
 		unsigned int max_read_buffer;
 		unsigned int max_request_size;
+		request_capture capture;
 };
 
 // THE MIDDLEMAN
@@ -76,6 +81,8 @@ class connection_mother {
 class connection_middleman {
 	private:
 		int connect_sock;
+		ip_address client_addr; // From accept, version 0 for unix sockets
+		bool known_family;
 		client_opts_t client_opts;
 		unsigned int written;
 		ev::io read_event;
@@ -95,3 +102,6 @@ class connection_middleman {
 		void handle_write(ev::io &watcher, int events_flags);
 		void handle_timeout(ev::timer &watcher, int events_flags);
 };
+
+// Open middlemen and the read buffers they reserve, for report?get=memory
+memory_usage connection_memory_usage();
@@ -0,0 +1,207 @@
+#include <string>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ip_address.h"
+
+static inline int hex_value(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+void ip_address::assign(uint8_t ip_version, const void *address) {
+	version = ip_version;
+	if (version == 4) {
+		memcpy(bytes, address, 4);
+		is_public = ipv4_is_public(bytes);
+	} else if (version == 6) {
+		memcpy(bytes, address, 16);
+		is_public = ipv6_is_public(bytes);
+	} else {
+		version = 0;
+		is_public = false;
+	}
+}
+
+bool ip_address::assign(const struct sockaddr_storage &sa) {
+	if (sa.ss_family == AF_INET) {
+		const struct sockaddr_in *s = reinterpret_cast<const struct sockaddr_in *>(&sa);
+		assign(4, &s->sin_addr);
+	} else if (sa.ss_family == AF_INET6) {
+		const struct sockaddr_in6 *s6 = reinterpret_cast<const struct sockaddr_in6 *>(&sa);
+		if (IN6_IS_ADDR_V4MAPPED(&s6->sin6_addr)) {
+			assign(4, s6->sin6_addr.s6_addr + 12);
+		} else {
+			assign(6, &s6->sin6_addr);
+		}
+	} else {
+		assign(0, NULL);
+		return sa.ss_family == AF_UNIX; // Taken from the real IP header instead
+	}
+	return true;
+}
+
+bool parse_ipv4(const char *begin, const char *end, uint8_t *out) {
+	const char *p = begin;
+	for (int part = 0; part < 4; part++) {
+		if (part > 0) {
+			if (p == end || *p != '.') return false;
+			p++;
+		}
+		const char *start = p;
+		unsigned int value = 0;
+		while (p != end && *p >= '0' && *p <= '9') {
+			value = value * 10 + (*p++ - '0');
+			if (value > 255) return false;
+		}
+		// Empty parts and leading zeros are rejected like inet_pton does
+		if (p == start || (p - start > 1 && *start == '0')) return false;
+		out[part] = value;
+	}
+	return p == end;
+}
+
+bool parse_ipv6(const char *begin, const char *end, uint8_t *out) {
+	uint8_t tmp[16];
+	int len = 0;
+	int gap = -1; // Where the :: is, if there is one
+	unsigned int value = 0, digits = 0;
+	const char *p = begin, *group = begin;
+	if (p == end) return false;
+	if (*p == ':' && (++p == end || *p != ':')) return false;
+	while (p != end) {
+		char c = *p++;
+		int h = hex_value(c);
+		if (h >= 0) {
+			if (++digits > 4) return false;
+			value = (value << 4) | h;
+		} else if (c == ':') {
+			group = p;
+			if (digits == 0) {
+				if (gap >= 0) return false;
+				gap = len;
+				continue;
+			}
+			if (p == end || len > 14) return false;
+			tmp[len++] = value >> 8;
+			tmp[len++] = value & 0xFF;
+			value = digits = 0;
+		} else if (c == '.' && len <= 12) {
+			// Embedded IPv4 address in the last 32 bits
+			if (!parse_ipv4(group, end, tmp + len)) return false;
+			len += 4;
+			digits = 0;
+			break;
+		} else {
+			return false;
+		}
+	}
+	if (digits > 0) {
+		if (len > 14) return false;
+		tmp[len++] = value >> 8;
+		tmp[len++] = value & 0xFF;
+	}
+	if (gap >= 0) {
+		if (len == 16) return false;
+		int tail = len - gap;
+		memset(out, 0, 16);
+		memcpy(out, tmp, gap);
+		memcpy(out + 16 - tail, tmp + gap, tail);
+		return true;
+	}
+	if (len != 16) return false;
+	memcpy(out, tmp, 16);
+	return true;
+}
+
+bool parse_ip(const char *begin, const char *end, ip_address &addr) {
+	// Percent-decode into a buffer big enough for any valid address
+	char text[INET6_ADDRSTRLEN];
+	size_t len = 0;
+	bool colon = false;
+	for (const char *p = begin; p != end; p++) {
+		char c = *p;
+		if (c == '%' && end - p > 2 && hex_value(p[1]) >= 0 && hex_value(p[2]) >= 0) {
+			c = (hex_value(p[1]) << 4) | hex_value(p[2]);
+			p += 2;
+		}
+		if (len == sizeof(text)) return false;
+		colon |= c == ':';
+		text[len++] = c;
+	}
+	if (colon) {
+		if (!parse_ipv6(text, text + len, addr.bytes)) return false;
+		addr.version = 6;
+		addr.is_public = ipv6_is_public(addr.bytes);
+	} else {
+		if (!parse_ipv4(text, text + len, addr.bytes)) return false;
+		addr.version = 4;
+		addr.is_public = ipv4_is_public(addr.bytes);
+	}
+	return true;
+}
+
+bool parse_first_hop(const std::string &header, ip_address &addr) {
+	const char *begin = header.data();
+	const char *end = static_cast<const char *>(memchr(begin, ',', header.length()));
+	if (end == NULL) {
+		end = begin + header.length();
+	}
+	while (begin != end && (*begin == ' ' || *begin == '\t')) begin++;
+	while (end != begin && (end[-1] == ' ' || end[-1] == '\t')) end--;
+	return parse_ip(begin, end, addr);
+}
+
+#if defined(__DEBUG_BUILD__)
+/*
+ *  Allow any addresses in a debug build, it's expected
+ *  that we will generate local traffic for testing.
+ */
+bool ipv4_is_public(const uint8_t *addr) {return true;}
+bool ipv6_is_public(const uint8_t *addr) {return true;}
+#else
+bool ipv4_is_public(const uint8_t *addr) {
+
+	// Match against reserved ranges
+	if (addr[0] == 10) return false;                            // 10.0.0.0/8
+	if (addr[0] == 172 && (addr[1] & 0xf0) == 16) return false; // 172.16.0.0/12
+	if (addr[0] == 192 && addr[1] == 168) return false;         // 192.168.0.0/16
+	if (addr[0] == 169 && addr[1] == 254) return false;         // 169.254.0.0/16
+	if (addr[0] == 100 && (addr[1] & 0xc0) == 64) return false; // 100.64.0.0/10
+	if (addr[0] == 127) return false;                           // 127.0.0.0/8
+	return true;
+
+}
+
+bool ipv6_is_public(const uint8_t *addr) {
+	uint16_t word = (addr[0] << 8) | addr[1];
+	uint32_t dword = (static_cast<uint32_t>(word) << 16) | (addr[2] << 8) | addr[3];
+
+	// Match against reserved ranges
+	if (dword == 0x00000000) return false; // Loopback / v4 compat v6
+	if (word  == 0xfe80    ) return false; // Link local
+	if (word  == 0xfc00    ) return false; // Unique Local - private subnet
+	if (word  == 0xfec0    ) return false; // site-local [deprecated]
+	if (word  == 0x3ffe    ) return false; // 6bone [deprecated]
+	if (dword == 0x20010db8) return false; // documentation examples, unroutable
+	if (dword == 0x20010000) return false; // Teredo
+	if (word  == 0x2002    ) return false; // 6to4
+	return true;
+
+}
+#endif
+
+std::string ip_to_string(const std::string &binary) {
+	char str[INET6_ADDRSTRLEN] = "";
+	if (binary.length() == 4) {
+		inet_ntop(AF_INET, binary.data(), str, sizeof(str));
+	} else if (binary.length() == 16) {
+		inet_ntop(AF_INET6, binary.data(), str, sizeof(str));
+	}
+	return str;
+}
@@ -0,0 +1,49 @@
+#ifndef RADIANCE_IP_ADDRESS_H
+#define RADIANCE_IP_ADDRESS_H
+
+#include <string>
+#include <stdint.h>
+
+#include "../autoconf.h"
+
+struct sockaddr_storage;
+
+// A numeric client address, bytes in network order
+struct ip_address {
+	uint8_t version; // 4 or 6, 0 until parsed or for unix sockets
+	bool is_public;
+	uint8_t bytes[16];
+	inline size_t length() const { return version == 4 ? 4 : (version == 6 ? 16 : 0); }
+	// The 4 or 16 byte form peers and database records use
+	inline std::string binary() const { return std::string(reinterpret_cast<const char*>(bytes), length()); }
+	// Set from 4 or 16 bytes in network order, or clear for version 0
+	void assign(uint8_t ip_version, const void *address);
+	// Set from a socket address, IPv4-mapped IPv6 becomes IPv4. False for unknown families.
+	bool assign(const struct sockaddr_storage &sa);
+};
+
+/*
+ * Numeric address parsing for announce parameters and proxy headers. These
+ * accept the same text as inet_pton, never allocate and don't go through
+ * the resolver like getaddrinfo does. parse_ip() also takes percent-encoded
+ * input straight from the query string.
+ */
+bool parse_ipv4(const char *begin, const char *end, uint8_t *out);
+bool parse_ipv6(const char *begin, const char *end, uint8_t *out);
+bool parse_ip(const char *begin, const char *end, ip_address &addr);
+inline bool parse_ip(const std::string &text, ip_address &addr) {
+	return parse_ip(text.data(), text.data() + text.length(), addr);
+}
+// The first entry of an X-Forwarded-For style list, which is the client itself
+bool parse_first_hop(const std::string &header, ip_address &addr);
+
+// Reserved and private ranges aren't public. Debug builds accept everything.
+bool ipv4_is_public(const uint8_t *addr);
+bool ipv6_is_public(const uint8_t *addr);
+
+// Text form of a 4 or 16 byte address, for log messages
+std::string ip_to_string(const std::string &binary);
+inline std::string ip_to_string(const ip_address &addr) {
+	return ip_to_string(addr.binary());
+}
+#endif
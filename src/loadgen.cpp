@@ -0,0 +1,621 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <getopt.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * HTTP load generator for the tracker (make tools).
+ *
+ * Users and torrents are registered through the update API first, the same
+ * way install/radiance_test.py does it, then every thread drives its share of
+ * the connections with poll(). Peers walk through started, regular,
+ * completed, paused and stopped announces in the configured proportions and
+ * a configurable share of requests are scrapes. Connections are either kept
+ * alive (the tracker needs keepalive_timeout > 0) or reopened per request.
+ *
+ * Latency is measured from the moment a request is handed to the socket (or
+ * the connect starts) until its response is complete.
+ */
+
+enum request_kind { STARTED, ANNOUNCE, COMPLETED, STOPPED, PAUSED, SCRAPE, REQUEST_KINDS };
+static const char *kind_names[] = { "started", "announce", "completed", "stopped", "paused", "scrape" };
+
+struct loadgen_opts {
+	std::string host = "127.0.0.1";
+	unsigned int port = 2710;
+	std::string unix_path;
+	bool keepalive = false;
+	unsigned int connections = 64;
+	unsigned int threads = 4;
+	unsigned int duration = 30;
+	unsigned int rate = 0; // Requests per second over all threads, 0 for as fast as possible
+	unsigned int users = 1000;
+	unsigned int torrents = 1000;
+	unsigned int peers = 10000;
+	unsigned int scrape = 10; // Percent of requests
+	unsigned int scrape_hashes = 1;
+	unsigned int completed = 2; // Percent of announces from started peers
+	unsigned int stopped = 2;
+	unsigned int paused = 1;
+	unsigned int numwant = 50;
+	unsigned int first_id = 1;
+	unsigned int seed = 1;
+	bool setup = true;
+	std::string site_password = "00000000000000000000000000000000";
+};
+
+struct lg_user {
+	std::string passkey;
+	std::string ip;
+	uint16_t port;
+};
+
+struct lg_torrent {
+	std::string info_hash; // Percent-encoded
+	int64_t size;
+};
+
+struct lg_peer {
+	unsigned int user;
+	unsigned int torrent;
+	std::string peer_id;
+	int64_t left;
+	int64_t uploaded;
+	int64_t downloaded;
+	bool started;
+};
+
+struct thread_result {
+	uint64_t sent[REQUEST_KINDS];
+	uint64_t ok;
+	uint64_t failures; // Tracker answered with a failure reason
+	uint64_t errors;   // Connect, read or write errors and timeouts
+	uint64_t connects;
+	uint64_t bytes_in;
+	std::vector<uint32_t> latencies; // Microseconds
+};
+
+struct connection {
+	int fd;
+	enum { IDLE, CONNECTING, WRITING, READING } state;
+	request_kind kind;
+	std::string out;
+	std::string in;
+	size_t sent;
+	std::chrono::steady_clock::time_point start;
+};
+
+static loadgen_opts lg;
+static struct sockaddr_storage server_addr;
+static socklen_t server_addr_len;
+static std::vector<lg_user> users;
+static std::vector<lg_torrent> torrents;
+
+static std::string random_string(std::mt19937 &rng, size_t length, const char *chars) {
+	size_t n = strlen(chars);
+	std::string out;
+	for (size_t i = 0; i < length; i++) {
+		out.push_back(chars[rng() % n]);
+	}
+	return out;
+}
+
+static std::string percent_encode(const std::string &in) {
+	static const char hex[] = "0123456789ABCDEF";
+	std::string out;
+	for (unsigned char c: in) {
+		out.push_back('%');
+		out.push_back(hex[c >> 4]);
+		out.push_back(hex[c & 0xF]);
+	}
+	return out;
+}
+
+static bool resolve() {
+	memset(&server_addr, 0, sizeof(server_addr));
+	if (!lg.unix_path.empty()) {
+		struct sockaddr_un *sun = (struct sockaddr_un *)&server_addr;
+		sun->sun_family = AF_UNIX;
+		strncpy(sun->sun_path, lg.unix_path.c_str(), sizeof(sun->sun_path) - 1);
+		server_addr_len = sizeof(struct sockaddr_un);
+		return true;
+	}
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = PF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	int err = getaddrinfo(lg.host.c_str(), std::to_string(lg.port).c_str(), &hints, &res);
+	if (err != 0) {
+		std::cerr << "Could not resolve " << lg.host << ": " << gai_strerror(err) << std::endl;
+		return false;
+	}
+	memcpy(&server_addr, res->ai_addr, res->ai_addrlen);
+	server_addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+	return true;
+}
+
+// Non-blocking connect, returns -1 on immediate failure
+static int open_connection(bool &pending) {
+	int fd = socket(server_addr.ss_family, SOCK_STREAM, 0);
+	if (fd == -1) {
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	if (connect(fd, (struct sockaddr *)&server_addr, server_addr_len) == 0) {
+		pending = false;
+		return fd;
+	}
+	if (errno == EINPROGRESS) {
+		pending = true;
+		return fd;
+	}
+	close(fd);
+	return -1;
+}
+
+// Length of the complete response at the start of buf, or 0 if more is needed
+static size_t response_length(const std::string &buf, bool &server_close) {
+	size_t head_end = buf.find("\r\n\r\n");
+	if (head_end == std::string::npos) {
+		return 0;
+	}
+	size_t content_length = 0;
+	server_close = false;
+	size_t pos = 0;
+	while (pos < head_end) {
+		size_t eol = buf.find("\r\n", pos);
+		if (strncasecmp(&buf[pos], "Content-Length:", 15) == 0) {
+			content_length = strtoul(&buf[pos + 15], NULL, 10);
+		} else if (strncasecmp(&buf[pos], "Connection: Close", 17) == 0) {
+			server_close = true;
+		}
+		pos = eol + 2;
+	}
+	size_t total = head_end + 4 + content_length;
+	return buf.size() >= total ? total : 0;
+}
+
+static std::string request_tail() {
+	return std::string(" HTTP/1.1\r\nHost: ") + (lg.unix_path.empty() ? lg.host : "localhost")
+		+ "\r\nUser-Agent: radiance-loadgen/1.0\r\nConnection: " + (lg.keepalive ? "Keep-Alive" : "close") + "\r\n\r\n";
+}
+
+// Blocking request used while registering users and torrents
+static bool blocking_request(const std::string &request) {
+	bool pending;
+	int fd = open_connection(pending);
+	if (fd == -1) {
+		return false;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+	if (pending) {
+		struct pollfd pfd = { fd, POLLOUT, 0 };
+		poll(&pfd, 1, 5000);
+	}
+	std::string req = request + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+	bool ok = send(fd, req.data(), req.size(), MSG_NOSIGNAL) == (ssize_t)req.size();
+	std::string in;
+	char buf[4096];
+	bool server_close;
+	while (ok && response_length(in, server_close) == 0) {
+		ssize_t ret = recv(fd, buf, sizeof(buf), 0);
+		if (ret <= 0) {
+			ok = false;
+			break;
+		}
+		in.append(buf, ret);
+	}
+	close(fd);
+	return ok && in.compare(0, 12, "HTTP/1.1 204") == 0;
+}
+
+static bool register_population() {
+	unsigned int failed = 0;
+	for (unsigned int i = 0; i < users.size(); i++) {
+		if (!blocking_request("GET /" + lg.site_password + "/update?action=add_user&id=" + std::to_string(lg.first_id + i)
+				+ "&passkey=" + users[i].passkey + "&visible=1")) {
+			failed++;
+		}
+	}
+	for (unsigned int i = 0; i < torrents.size(); i++) {
+		if (!blocking_request("GET /" + lg.site_password + "/update?action=add_torrent&id=" + std::to_string(lg.first_id + i)
+				+ "&info_hash=" + torrents[i].info_hash + "&freetorrent=0")) {
+			failed++;
+		}
+	}
+	if (failed != 0) {
+		std::cerr << failed << " of " << users.size() + torrents.size() << " update requests failed, check site_password" << std::endl;
+	}
+	return failed != users.size() + torrents.size();
+}
+
+static std::string next_request(std::mt19937 &rng, std::vector<lg_peer> &peers, request_kind &kind) {
+	if (rng() % 100 < lg.scrape) {
+		kind = SCRAPE;
+		std::string request = "GET /" + users[rng() % users.size()].passkey + "/scrape?";
+		for (unsigned int i = 0; i < lg.scrape_hashes; i++) {
+			request += (i == 0 ? "info_hash=" : "&info_hash=") + torrents[rng() % torrents.size()].info_hash;
+		}
+		return request + request_tail();
+	}
+
+	lg_peer &p = peers[rng() % peers.size()];
+	const lg_user &u = users[p.user];
+	const lg_torrent &t = torrents[p.torrent];
+	std::string event;
+	unsigned int roll = rng() % 100;
+	if (!p.started) {
+		kind = STARTED;
+		event = "&event=started";
+		p.started = true;
+	} else if (roll < lg.stopped) {
+		kind = STOPPED;
+		event = "&event=stopped";
+		p.started = false;
+	} else if (roll < lg.stopped + lg.completed && p.left > 0) {
+		kind = COMPLETED;
+		event = "&event=completed";
+		p.downloaded += p.left;
+		p.left = 0;
+	} else if (roll < lg.stopped + lg.completed + lg.paused) {
+		kind = PAUSED;
+		event = "&event=paused";
+	} else {
+		kind = ANNOUNCE;
+		int64_t chunk = std::min(p.left, (int64_t)(rng() % (1 << 24)));
+		p.downloaded += chunk;
+		p.left -= chunk;
+		p.uploaded += rng() % (1 << 24);
+	}
+	return "GET /" + u.passkey + "/announce?info_hash=" + t.info_hash + "&peer_id=" + p.peer_id
+		+ "&ip=" + u.ip + "&port=" + std::to_string(u.port) + "&uploaded=" + std::to_string(p.uploaded)
+		+ "&downloaded=" + std::to_string(p.downloaded) + "&left=" + std::to_string(p.left)
+		+ "&corrupt=0&numwant=" + std::to_string(lg.numwant) + "&compact=1&no_peer_id=1" + event + request_tail();
+}
+
+static void close_connection(connection &c) {
+	if (c.fd != -1) {
+		close(c.fd);
+		c.fd = -1;
+	}
+	c.state = connection::IDLE;
+	c.in.clear();
+}
+
+static void run_thread(unsigned int index, std::vector<lg_peer> peers, unsigned int connections, thread_result &result) {
+	std::mt19937 rng(lg.seed * 7919 + index);
+	memset(result.sent, 0, sizeof(result.sent));
+	result.ok = result.failures = result.errors = result.connects = result.bytes_in = 0;
+
+	std::vector<connection> conns(connections);
+	for (connection &c: conns) {
+		c.fd = -1;
+		c.state = connection::IDLE;
+	}
+	auto interval = std::chrono::nanoseconds(lg.rate == 0 ? 0 : (uint64_t)1000000000 * lg.threads / lg.rate);
+	auto now = std::chrono::steady_clock::now();
+	auto end = now + std::chrono::seconds(lg.duration);
+	auto next_send = now;
+	std::vector<struct pollfd> pfds;
+	std::vector<connection*> polled;
+	char buf[16384];
+
+	while ((now = std::chrono::steady_clock::now()) < end) {
+		// Don't let a stall turn into a burst
+		if (lg.rate != 0 && next_send + std::chrono::seconds(1) < now) {
+			next_send = now;
+		}
+		for (connection &c: conns) {
+			if (c.state != connection::IDLE) {
+				if (now - c.start > std::chrono::seconds(10)) {
+					result.errors++;
+					close_connection(c);
+				}
+				continue;
+			}
+			if (lg.rate != 0) {
+				if (next_send > now) {
+					continue;
+				}
+				next_send += interval;
+			}
+			c.out = next_request(rng, peers, c.kind);
+			c.sent = 0;
+			c.start = now;
+			result.sent[c.kind]++;
+			if (c.fd == -1) {
+				bool pending;
+				c.fd = open_connection(pending);
+				if (c.fd == -1) {
+					result.errors++;
+					continue;
+				}
+				result.connects++;
+				c.state = pending ? connection::CONNECTING : connection::WRITING;
+			} else {
+				c.state = connection::WRITING;
+			}
+		}
+
+		pfds.clear();
+		polled.clear();
+		for (connection &c: conns) {
+			if (c.state != connection::IDLE) {
+				short events = c.state == connection::READING ? POLLIN : POLLOUT;
+				pfds.push_back({ c.fd, events, 0 });
+				polled.push_back(&c);
+			}
+		}
+		int timeout = 10;
+		if (lg.rate != 0) {
+			timeout = std::max((int64_t)0, (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(next_send - now).count());
+			timeout = std::min(timeout, 10);
+		}
+		if (poll(pfds.data(), pfds.size(), timeout) <= 0) {
+			continue;
+		}
+
+		for (size_t i = 0; i < pfds.size(); i++) {
+			connection &c = *polled[i];
+			if (pfds[i].revents == 0) {
+				continue;
+			}
+			if (c.state == connection::CONNECTING) {
+				int err = 0;
+				socklen_t len = sizeof(err);
+				getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+				if (err != 0) {
+					result.errors++;
+					close_connection(c);
+					continue;
+				}
+				c.state = connection::WRITING;
+			}
+			if (c.state == connection::WRITING) {
+				ssize_t ret = send(c.fd, c.out.data() + c.sent, c.out.size() - c.sent, MSG_NOSIGNAL);
+				if (ret < 0 && errno != EAGAIN) {
+					result.errors++;
+					close_connection(c);
+					continue;
+				}
+				if (ret > 0) {
+					c.sent += ret;
+				}
+				if (c.sent == c.out.size()) {
+					c.state = connection::READING;
+				}
+				continue;
+			}
+
+			ssize_t ret = recv(c.fd, buf, sizeof(buf), 0);
+			if (ret <= 0) {
+				if (ret < 0 && errno == EAGAIN) {
+					continue;
+				}
+				result.errors++;
+				close_connection(c);
+				continue;
+			}
+			result.bytes_in += ret;
+			c.in.append(buf, ret);
+			bool server_close = false;
+			size_t length = response_length(c.in, server_close);
+			if (length == 0) {
+				continue;
+			}
+			result.latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - c.start).count());
+			if (c.in.find("failure reason", c.in.find("\r\n\r\n")) != std::string::npos) {
+				result.failures++;
+			} else {
+				result.ok++;
+			}
+			if (!lg.keepalive || server_close) {
+				close_connection(c);
+			} else {
+				c.state = connection::IDLE;
+				c.in.clear();
+			}
+		}
+	}
+	for (connection &c: conns) {
+		close_connection(c);
+	}
+}
+
+static void usage(const char *name) {
+	std::cout << "Usage: " << name << " [options]\n"
+		"  -H, --host HOST          tracker host (127.0.0.1)\n"
+		"  -p, --port PORT          tracker port (2710)\n"
+		"  -u, --unix PATH          connect to a unix socket instead\n"
+		"  -k, --keepalive          reuse connections instead of one per request\n"
+		"  -c, --connections N      concurrent connections (64)\n"
+		"  -t, --threads N          client threads (4)\n"
+		"  -d, --duration SECONDS   test length (30)\n"
+		"  -r, --rate N             target requests per second, 0 for unlimited (0)\n"
+		"  -s, --site-password PW   site_password for the update API\n"
+		"      --users N            users to register (1000)\n"
+		"      --torrents N         torrents to register (1000)\n"
+		"      --peers N            simulated peers (10000)\n"
+		"      --scrape PCT         share of requests that are scrapes (10)\n"
+		"      --scrape-hashes N    info hashes per scrape (1)\n"
+		"      --completed PCT      share of announces that complete (2)\n"
+		"      --stopped PCT        share of announces that stop (2)\n"
+		"      --paused PCT         share of announces that pause (1)\n"
+		"      --numwant N          numwant sent with announces (50)\n"
+		"      --first-id N         first user and torrent id to register (1)\n"
+		"      --seed N             random seed (1)\n"
+		"      --no-setup           users and torrents are already registered\n";
+}
+
+int main(int argc, char **argv) {
+	enum { OPT_USERS = 256, OPT_TORRENTS, OPT_PEERS, OPT_SCRAPE, OPT_SCRAPE_HASHES, OPT_COMPLETED, OPT_STOPPED,
+		OPT_PAUSED, OPT_NUMWANT, OPT_FIRST_ID, OPT_SEED, OPT_NO_SETUP };
+	static const struct option long_options[] = {
+		{ "host",          required_argument, NULL, 'H' },
+		{ "port",          required_argument, NULL, 'p' },
+		{ "unix",          required_argument, NULL, 'u' },
+		{ "keepalive",     no_argument,       NULL, 'k' },
+		{ "connections",   required_argument, NULL, 'c' },
+		{ "threads",       required_argument, NULL, 't' },
+		{ "duration",      required_argument, NULL, 'd' },
+		{ "rate",          required_argument, NULL, 'r' },
+		{ "site-password", required_argument, NULL, 's' },
+		{ "users",         required_argument, NULL, OPT_USERS },
+		{ "torrents",      required_argument, NULL, OPT_TORRENTS },
+		{ "peers",         required_argument, NULL, OPT_PEERS },
+		{ "scrape",        required_argument, NULL, OPT_SCRAPE },
+		{ "scrape-hashes", required_argument, NULL, OPT_SCRAPE_HASHES },
+		{ "completed",     required_argument, NULL, OPT_COMPLETED },
+		{ "stopped",       required_argument, NULL, OPT_STOPPED },
+		{ "paused",        required_argument, NULL, OPT_PAUSED },
+		{ "numwant",       required_argument, NULL, OPT_NUMWANT },
+		{ "first-id",      required_argument, NULL, OPT_FIRST_ID },
+		{ "seed",          required_argument, NULL, OPT_SEED },
+		{ "no-setup",      no_argument,       NULL, OPT_NO_SETUP },
+		{ NULL, 0, NULL, 0 }
+	};
+	int opt;
+	while ((opt = getopt_long(argc, argv, "H:p:u:kc:t:d:r:s:", long_options, NULL)) != -1) {
+		switch (opt) {
+			case 'H': lg.host = optarg; break;
+			case 'p': lg.port = atoi(optarg); break;
+			case 'u': lg.unix_path = optarg; break;
+			case 'k': lg.keepalive = true; break;
+			case 'c': lg.connections = atoi(optarg); break;
+			case 't': lg.threads = atoi(optarg); break;
+			case 'd': lg.duration = atoi(optarg); break;
+			case 'r': lg.rate = atoi(optarg); break;
+			case 's': lg.site_password = optarg; break;
+			case OPT_USERS: lg.users = atoi(optarg); break;
+			case OPT_TORRENTS: lg.torrents = atoi(optarg); break;
+			case OPT_PEERS: lg.peers = atoi(optarg); break;
+			case OPT_SCRAPE: lg.scrape = atoi(optarg); break;
+			case OPT_SCRAPE_HASHES: lg.scrape_hashes = atoi(optarg); break;
+			case OPT_COMPLETED: lg.completed = atoi(optarg); break;
+			case OPT_STOPPED: lg.stopped = atoi(optarg); break;
+			case OPT_PAUSED: lg.paused = atoi(optarg); break;
+			case OPT_NUMWANT: lg.numwant = atoi(optarg); break;
+			case OPT_FIRST_ID: lg.first_id = atoi(optarg); break;
+			case OPT_SEED: lg.seed = atoi(optarg); break;
+			case OPT_NO_SETUP: lg.setup = false; break;
+			default: usage(argv[0]); return EXIT_FAILURE;
+		}
+	}
+	if (lg.threads == 0 || lg.connections < lg.threads || lg.users == 0 || lg.torrents == 0 || lg.peers < lg.threads
+			|| lg.scrape_hashes == 0 || lg.site_password.length() != 32) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!resolve()) {
+		return EXIT_FAILURE;
+	}
+
+	// The population only depends on the seed, so --no-setup can reuse an earlier run's
+	std::mt19937 rng(lg.seed);
+	for (unsigned int i = 0; i < lg.users; i++) {
+		lg_user u;
+		u.passkey = random_string(rng, 32, "abcdefghijklmnopqrstuvwxyz0123456789");
+		u.ip = std::to_string(1 + rng() % 9) + '.' + std::to_string(rng() % 256) + '.' + std::to_string(rng() % 256) + '.' + std::to_string(1 + rng() % 254);
+		u.port = 1024 + rng() % 64000;
+		users.push_back(u);
+	}
+	for (unsigned int i = 0; i < lg.torrents; i++) {
+		std::string info_hash;
+		for (int b = 0; b < 20; b++) {
+			info_hash.push_back(static_cast<char>(rng() & 0xFF));
+		}
+		torrents.push_back({ percent_encode(info_hash), 1 + (int64_t)(rng() % ((int64_t)1 << 32)) });
+	}
+	std::vector<std::vector<lg_peer>> thread_peers(lg.threads);
+	for (unsigned int i = 0; i < lg.peers; i++) {
+		lg_peer p;
+		p.user = rng() % lg.users;
+		p.torrent = rng() % lg.torrents;
+		p.peer_id = "-LG0100-" + random_string(rng, 12, "0123456789abcdef");
+		p.left = (rng() % 10 < 3) ? 0 : torrents[p.torrent].size;
+		p.uploaded = 0;
+		p.downloaded = 0;
+		p.started = false;
+		thread_peers[i % lg.threads].push_back(p);
+	}
+
+	if (lg.setup) {
+		std::cout << "Registering " << lg.users << " users and " << lg.torrents << " torrents" << std::endl;
+		if (!register_population()) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::cout << "Running " << lg.duration << "s with " << lg.connections << " " << (lg.keepalive ? "keep-alive" : "close-mode")
+		<< " connections on " << lg.threads << " threads";
+	if (lg.rate != 0) {
+		std::cout << " at " << lg.rate << " requests/s";
+	}
+	std::cout << std::endl;
+
+	std::vector<thread_result> results(lg.threads);
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < lg.threads; i++) {
+		unsigned int connections = lg.connections / lg.threads + (i < lg.connections % lg.threads ? 1 : 0);
+		threads.push_back(std::thread(run_thread, i, thread_peers[i], connections, std::ref(results[i])));
+	}
+	for (std::thread &t: threads) {
+		t.join();
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	thread_result total;
+	memset(total.sent, 0, sizeof(total.sent));
+	total.ok = total.failures = total.errors = total.connects = total.bytes_in = 0;
+	for (thread_result &r: results) {
+		for (int k = 0; k < REQUEST_KINDS; k++) {
+			total.sent[k] += r.sent[k];
+		}
+		total.ok += r.ok;
+		total.failures += r.failures;
+		total.errors += r.errors;
+		total.connects += r.connects;
+		total.bytes_in += r.bytes_in;
+		total.latencies.insert(total.latencies.end(), r.latencies.begin(), r.latencies.end());
+	}
+	std::sort(total.latencies.begin(), total.latencies.end());
+	auto percentile = [&total](double p) -> uint32_t {
+		if (total.latencies.empty()) {
+			return 0;
+		}
+		return total.latencies[std::min(total.latencies.size() - 1, (size_t)(p * (total.latencies.size() - 1) + 0.5))];
+	};
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "sent           ";
+	for (int k = 0; k < REQUEST_KINDS; k++) {
+		std::cout << " " << kind_names[k] << " " << total.sent[k];
+	}
+	std::cout << std::endl;
+	std::cout << "responses       " << total.latencies.size() << " (" << total.ok << " ok, " << total.failures << " failures), "
+		<< total.errors << " errors, " << total.connects << " connects" << std::endl;
+	std::cout << "throughput      " << total.latencies.size() / elapsed << " responses/s, "
+		<< total.bytes_in / elapsed / 1048576 << " MiB/s in" << std::endl;
+	std::cout << "latency us      p50 " << percentile(0.5) << "  p90 " << percentile(0.9) << "  p99 " << percentile(0.99)
+		<< "  p99.9 " << percentile(0.999) << "  max " << (total.latencies.empty() ? 0 : total.latencies.back()) << std::endl;
+	return 0;
+}
@@ -35,21 +35,28 @@ void init_log(void) {
   boost::log::core::get()->add_global_attribute("Scope",
   boost::log::attributes::named_scope());
 
+  std::string syslog_level, syslog_path;
+  {
+    rcu_read_guard guard;
+    syslog_level = conf->get()->syslog_level;
+    syslog_path  = conf->get()->syslog_path;
+  }
+
   auto severity = boost::log::trivial::info;
-       if(conf->get_str("syslog_level") == "trace")    severity=boost::log::trivial::trace;
-  else if(conf->get_str("syslog_level") == "debug")    severity=boost::log::trivial::debug;
-  else if(conf->get_str("syslog_level") == "info")     severity=boost::log::trivial::info;
-  else if(conf->get_str("syslog_level") == "warning")  severity=boost::log::trivial::warning;
-  else if(conf->get_str("syslog_level") == "error")    severity=boost::log::trivial::error;
-  else if(conf->get_str("syslog_level") == "fatal")    severity=boost::log::trivial::fatal;
-  else if(conf->get_str("syslog_level") == "off") {
+       if(syslog_level == "trace")    severity=boost::log::trivial::trace;
+  else if(syslog_level == "debug")    severity=boost::log::trivial::debug;
+  else if(syslog_level == "info")     severity=boost::log::trivial::info;
+  else if(syslog_level == "warning")  severity=boost::log::trivial::warning;
+  else if(syslog_level == "error")    severity=boost::log::trivial::error;
+  else if(syslog_level == "fatal")    severity=boost::log::trivial::fatal;
+  else if(syslog_level == "off") {
     boost::log::core::get()->set_logging_enabled(false);
     std::cout << "Logging disabled" << std::endl;
     return;
   }
   // Misconfigured
   else {
-    std::cout << "Invalid log level: \"" << conf->get_str("syslog_level") << '"' << std::endl;
+    std::cout << "Invalid log level: \"" << syslog_level << '"' << std::endl;
     exit(EXIT_FAILURE);
   }
 
@@ -71,9 +78,9 @@ void init_log(void) {
     boost::log::expressions::format("[%1%] %2%")
     % fmtTimeStamp % boost::log::expressions::smessage;
 
-  if(conf->get_str("syslog_path") != "off") {
+  if(syslog_path != "off") {
     fsSink = boost::log::add_file_log(
-        boost::log::keywords::file_name = conf->get_str("syslog_path"),
+        boost::log::keywords::file_name = syslog_path,
         boost::log::keywords::min_free_space = 30 * 1024 * 1024,
         boost::log::keywords::open_mode = std::ios_base::app
     );
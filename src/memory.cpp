@@ -0,0 +1,111 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+
+#include "../autoconf.h"
+#include "memory.h"
+#include "pool.h"
+#include "response.h"
+
+#ifdef ENABLE_JEMALLOC
+#include <jemalloc/jemalloc.h>
+
+static uint64_t jemalloc_stat(const char *name) {
+	size_t value = 0;
+	size_t length = sizeof(value);
+	if (mallctl(name, &value, &length, NULL, 0) != 0) {
+		return 0;
+	}
+	return value;
+}
+#endif
+
+allocator_stats get_allocator_stats() {
+	allocator_stats s = {false, 0, 0, 0, 0, 0};
+#ifdef ENABLE_JEMALLOC
+	// The stats are only refreshed when the epoch is bumped
+	uint64_t epoch = 1;
+	size_t length = sizeof(epoch);
+	if (mallctl("epoch", &epoch, &length, &epoch, length) != 0) {
+		return s;
+	}
+	s.available = true;
+	s.allocated = jemalloc_stat("stats.allocated");
+	s.active    = jemalloc_stat("stats.active");
+	s.resident  = jemalloc_stat("stats.resident");
+	s.mapped    = jemalloc_stat("stats.mapped");
+	s.metadata  = jemalloc_stat("stats.metadata");
+#endif
+	return s;
+}
+
+uint64_t process_resident() {
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL) {
+		return 0;
+	}
+	unsigned long long size, resident;
+	int fields = fscanf(statm, "%llu %llu", &size, &resident);
+	fclose(statm);
+	if (fields != 2) {
+		return 0;
+	}
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+std::string memory_report(const std::vector<memory_usage> &usage, client_opts_t &client_opts) {
+	std::stringstream output;
+	uint64_t estimated = 0;
+	output << "{" << std::endl
+	<< R"(  "structures": {)" << std::endl;
+	for (auto u = usage.begin(); u != usage.end(); ++u) {
+		output << R"(    ")" << u->name << R"(": { "count": )" << u->count
+		<< R"(, "buckets": )" << u->buckets
+		<< R"(, "nodes": )" << u->nodes
+		<< R"(, "strings": )" << u->strings
+		<< R"(, "total": )" << u->total() << " }";
+		if (u + 1 != usage.end()) output << ',';
+		output << std::endl;
+		estimated += u->total();
+	}
+	output << "  }," << std::endl
+	<< R"(  "estimated total": )" << estimated << ',' << std::endl;
+
+	// Exact, these are counted as objects come and go
+	std::vector<pool_stats> pools = get_pool_stats();
+	output << R"(  "pools": {)" << std::endl;
+	for (auto p = pools.begin(); p != pools.end(); ++p) {
+		output << R"(    ")" << p->object_size << R"(": { "objects": )" << p->objects
+		<< R"(, "slabs": )" << p->slabs
+		<< R"(, "bytes": )" << p->slabs * SLAB_SIZE
+		<< R"(, "used": )" << p->objects * p->object_size << " }";
+		if (p + 1 != pools.end()) output << ',';
+		output << std::endl;
+	}
+	slab_stats slabs = get_slab_stats();
+	output << "  }," << std::endl
+	<< R"(  "slabs": { "mapped": )" << slabs.mapped
+	<< R"(, "huge pages": )" << slabs.huge
+	<< R"(, "in use": )" << slabs.slabs * SLAB_SIZE
+	<< R"(, "released": )" << slabs.free_slabs * SLAB_SIZE
+	<< R"(, "fixed": )" << slabs.fixed
+	<< R"(, "large": )" << slabs.large << " }," << std::endl;
+
+	allocator_stats alloc = get_allocator_stats();
+	if (alloc.available) {
+		// Share of the allocator's active pages not backing live allocations
+		double fragmentation = alloc.active == 0 ? 0 : static_cast<double>(alloc.active - alloc.allocated) / alloc.active;
+		output << R"(  "allocator": { "allocated": )" << alloc.allocated
+		<< R"(, "active": )" << alloc.active
+		<< R"(, "resident": )" << alloc.resident
+		<< R"(, "mapped": )" << alloc.mapped
+		<< R"(, "metadata": )" << alloc.metadata
+		<< R"(, "fragmentation": )" << fragmentation << " }," << std::endl;
+	}
+	output << R"(  "resident": )" << process_resident() << std::endl
+	<< "}" << std::endl;
+	client_opts.json = true;
+	return response(output.str(), client_opts, 200);
+}
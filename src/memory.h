@@ -0,0 +1,65 @@
+#ifndef RADIANCE_MEMORY_H
+#define RADIANCE_MEMORY_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "radiance.h"
+
+/*
+ * One structure's line in report?get=memory. The sizes are estimates worked
+ * out from element counts and the container layouts. Only the torrent list is
+ * walked, for the token counts, so the report is cheap enough to poll every
+ * minute.
+ */
+struct memory_usage {
+	std::string name;
+	uint64_t count;   // Entries, peers, connections...
+	uint64_t buckets; // Hash table bucket arrays
+	uint64_t nodes;   // Container nodes and fixed size objects
+	uint64_t strings; // Heap allocated keys, addresses and buffers
+	inline uint64_t total() const { return buckets + nodes + strings; }
+};
+
+// What the allocator itself says, only filled in when built with jemalloc
+struct allocator_stats {
+	bool available;
+	uint64_t allocated; // Bytes the program asked for
+	uint64_t active;    // Bytes in pages with live allocations
+	uint64_t resident;  // Bytes of physically resident allocator pages
+	uint64_t mapped;
+	uint64_t metadata;
+};
+allocator_stats get_allocator_stats();
+
+// Resident set size from /proc/self/statm, 0 if that can't be read
+uint64_t process_resident();
+
+std::string memory_report(const std::vector<memory_usage> &usage, client_opts_t &client_opts);
+
+// Bytes glibc malloc uses for a request of this size, chunk header included
+inline uint64_t malloc_size(uint64_t size) {
+	uint64_t chunk = (size + 8 + 15) & ~static_cast<uint64_t>(15);
+	return chunk < 32 ? 32 : chunk;
+}
+
+// Heap bytes behind a std::string of this length, short ones live inline
+inline uint64_t string_heap(uint64_t length) {
+	return length < 16 ? 0 : malloc_size(length + 1);
+}
+
+// Hash nodes hold the next pointer, the value and the cached hash of string keys
+template <typename Map> inline uint64_t hash_node_size() {
+	return sizeof(void*) + sizeof(typename Map::value_type) + sizeof(size_t);
+}
+
+// Tree nodes hold the colour, parent and child pointers and the value
+template <typename Map> inline uint64_t tree_node_size() {
+	return 4 * sizeof(void*) + sizeof(typename Map::value_type);
+}
+
+template <typename Map> inline uint64_t bucket_bytes(const Map &map) {
+	return map.bucket_count() * sizeof(void*);
+}
+#endif
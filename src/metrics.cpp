@@ -0,0 +1,261 @@
+#include <string>
+#include <vector>
+#include <mutex>
+#include <ctime>
+
+#include "radiance.h"
+#include "metrics.h"
+#include "tracker_mutex.h"
+
+// All histograms register themselves here so render_metrics() can find them
+static std::vector<const histogram*> &histograms() {
+	static std::vector<const histogram*> list;
+	return list;
+}
+static std::mutex &histograms_lock() {
+	static std::mutex lock;
+	return lock;
+}
+
+histogram request_latency("radiance_request_duration_seconds", "Time spent handling a single request", {
+	50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000
+});
+
+histogram reaper_slice_duration("radiance_reaper_slice_duration_seconds", "Time the reaper held the torrent list in one slice", {
+	50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000
+});
+
+// Microseconds as a decimal number of seconds, e.g. 2500 -> 0.0025
+static void append_seconds(std::string &out, uint64_t usecs) {
+	out += std::to_string(usecs / 1000000);
+	uint64_t frac = usecs % 1000000;
+	if (frac != 0) {
+		std::string digits = std::to_string(frac);
+		digits.insert(0, 6 - digits.length(), '0');
+		digits.erase(digits.find_last_not_of('0') + 1);
+		out += '.';
+		out += digits;
+	}
+}
+
+static void append_family(std::string &out, const char *name, const char *type, const char *help) {
+	out += "# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += "\n# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += '\n';
+}
+
+static void append_sample(std::string &out, const char *name, const char *suffix, uint64_t value) {
+	out += name;
+	out += suffix;
+	out += ' ';
+	out += std::to_string(value);
+	out += '\n';
+}
+
+static void append_gauge(std::string &out, const char *name, const char *help, uint64_t value) {
+	append_family(out, name, "gauge", help);
+	append_sample(out, name, "", value);
+}
+
+static void append_counter(std::string &out, const char *name, const char *help, uint64_t value) {
+	append_family(out, name, "counter", help);
+	append_sample(out, name, "_total", value);
+}
+
+static void append_labelled(std::string &out, const char *name, const char *label, const char *label_value, uint64_t value) {
+	out += name;
+	out += '{';
+	out += label;
+	out += "=\"";
+	out += label_value;
+	out += "\"} ";
+	out += std::to_string(value);
+	out += '\n';
+}
+
+static void append_labelled_seconds(std::string &out, const char *name, const char *label, const char *label_value, uint64_t usecs) {
+	out += name;
+	out += '{';
+	out += label;
+	out += "=\"";
+	out += label_value;
+	out += "\"} ";
+	append_seconds(out, usecs);
+	out += '\n';
+}
+
+histogram::histogram(const std::string &name, const std::string &help, const std::vector<uint64_t> &bounds) :
+	name(name), help(help), bounds(bounds), sum(0)
+{
+	buckets = new std::atomic<uint64_t>[bounds.size() + 1];
+	for (size_t i = 0; i <= bounds.size(); i++) {
+		buckets[i] = 0;
+	}
+	std::lock_guard<std::mutex> lock(histograms_lock());
+	histograms().push_back(this);
+}
+
+histogram::~histogram() {
+	std::lock_guard<std::mutex> lock(histograms_lock());
+	auto &list = histograms();
+	for (auto it = list.begin(); it != list.end(); ++it) {
+		if (*it == this) {
+			list.erase(it);
+			break;
+		}
+	}
+	delete[] buckets;
+}
+
+void histogram::observe(uint64_t usecs) {
+	size_t i = 0;
+	while (i < bounds.size() && usecs > bounds[i]) {
+		i++;
+	}
+	buckets[i].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(usecs, std::memory_order_relaxed);
+}
+
+void histogram::render(std::string &out) const {
+	// Copy first so the cumulative counts can't go backwards mid-render
+	std::vector<uint64_t> snap(bounds.size() + 1);
+	for (size_t i = 0; i <= bounds.size(); i++) {
+		snap[i] = buckets[i].load(std::memory_order_relaxed);
+	}
+	uint64_t snap_sum = sum.load(std::memory_order_relaxed);
+
+	append_family(out, name.c_str(), "histogram", help.c_str());
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i <= bounds.size(); i++) {
+		cumulative += snap[i];
+		out += name;
+		out += "_bucket{le=\"";
+		if (i < bounds.size()) {
+			append_seconds(out, bounds[i]);
+		} else {
+			out += "+Inf";
+		}
+		out += "\"} ";
+		out += std::to_string(cumulative);
+		out += '\n';
+	}
+	out += name;
+	out += "_count ";
+	out += std::to_string(cumulative);
+	out += '\n';
+	out += name;
+	out += "_sum ";
+	append_seconds(out, snap_sum);
+	out += '\n';
+}
+
+void take_metrics_snapshot(metrics_snapshot &snap) {
+	snap.start_time         = stats.start_time;
+	snap.uptime             = time(NULL) - stats.start_time;
+	snap.open_connections   = stats.open_connections;
+	snap.opened_connections = stats.opened_connections;
+	snap.connection_rate    = stats.connection_rate;
+	snap.requests           = stats.requests;
+	snap.request_rate       = stats.request_rate;
+	snap.announcements      = stats.announcements;
+	snap.succ_announcements = stats.succ_announcements;
+	snap.scrapes            = stats.scrapes;
+	snap.leechers           = stats.leechers;
+	snap.seeders            = stats.seeders;
+	snap.ipv4_peers         = stats.ipv4_peers;
+	snap.ipv6_peers         = stats.ipv6_peers;
+	snap.bytes_read         = stats.bytes_read;
+	snap.bytes_written      = stats.bytes_written;
+	snap.torrent_queue      = stats.torrent_queue;
+	snap.user_queue         = stats.user_queue;
+	snap.peer_queue         = stats.peer_queue;
+	snap.peer_hist_queue    = stats.peer_hist_queue;
+	snap.snatch_queue       = stats.snatch_queue;
+	snap.token_queue        = stats.token_queue;
+	snap.reaper_cycles           = stats.reaper_cycles;
+	snap.reaper_last_slices      = stats.reaper_last_slices;
+	snap.reaper_last_cycle_usecs = stats.reaper_last_cycle_usecs;
+	snap.full_scrape_locked_walks = stats.full_scrape_locked_walks;
+}
+
+// OpenMetrics text exposition, see https://openmetrics.io
+std::string render_metrics() {
+	metrics_snapshot snap;
+	take_metrics_snapshot(snap);
+
+	std::string out;
+	out.reserve(4096);
+	append_gauge(out, "radiance_start_time_seconds", "Unix time the tracker was started", snap.start_time);
+	append_gauge(out, "radiance_uptime_seconds", "Seconds since the tracker was started", snap.uptime);
+	append_gauge(out, "radiance_open_connections", "Currently open client connections", snap.open_connections);
+	append_counter(out, "radiance_connections", "Client connections accepted", snap.opened_connections);
+	append_gauge(out, "radiance_connection_rate", "Connections per second over the last schedule interval", snap.connection_rate);
+	append_counter(out, "radiance_requests", "Requests handled", snap.requests);
+	append_gauge(out, "radiance_request_rate", "Requests per second over the last schedule interval", snap.request_rate);
+	append_counter(out, "radiance_announces", "Announces received", snap.announcements);
+	append_counter(out, "radiance_announces_successful", "Announces answered with a peer list", snap.succ_announcements);
+	append_counter(out, "radiance_scrapes", "Scrapes received", snap.scrapes);
+	append_gauge(out, "radiance_leechers", "Leechers tracked", snap.leechers);
+	append_gauge(out, "radiance_seeders", "Seeders tracked", snap.seeders);
+
+	append_family(out, "radiance_peers", "gauge", "Peers with a public address by address family");
+	append_labelled(out, "radiance_peers", "family", "ipv4", snap.ipv4_peers);
+	append_labelled(out, "radiance_peers", "family", "ipv6", snap.ipv6_peers);
+
+	append_counter(out, "radiance_read_bytes", "Bytes read from clients", snap.bytes_read);
+	append_counter(out, "radiance_written_bytes", "Bytes written to clients", snap.bytes_written);
+
+	append_family(out, "radiance_db_queue_length", "gauge", "Queries waiting to be flushed to the database");
+	append_labelled(out, "radiance_db_queue_length", "queue", "torrent", snap.torrent_queue);
+	append_labelled(out, "radiance_db_queue_length", "queue", "user", snap.user_queue);
+	append_labelled(out, "radiance_db_queue_length", "queue", "peer", snap.peer_queue);
+	append_labelled(out, "radiance_db_queue_length", "queue", "peer_history", snap.peer_hist_queue);
+	append_labelled(out, "radiance_db_queue_length", "queue", "snatch", snap.snatch_queue);
+	append_labelled(out, "radiance_db_queue_length", "queue", "token", snap.token_queue);
+
+	append_counter(out, "radiance_reaper_cycles", "Completed reaper runs", snap.reaper_cycles);
+	append_gauge(out, "radiance_reaper_last_cycle_slices", "Slices the last reaper run was split into", snap.reaper_last_slices);
+	append_family(out, "radiance_reaper_last_cycle_seconds", "gauge", "Wall time of the last reaper run, yields included");
+	out += "radiance_reaper_last_cycle_seconds ";
+	append_seconds(out, snap.reaper_last_cycle_usecs);
+	out += '\n';
+	append_counter(out, "radiance_full_scrape_locked_walks", "Full scrapes finished with the torrent list locked after it kept being rehashed", snap.full_scrape_locked_walks);
+
+	std::vector<lock_stats> locks = get_lock_stats();
+	if (!locks.empty()) {
+		append_family(out, "radiance_lock_acquisitions", "counter", "Times the lock was taken");
+		for (const lock_stats &l: locks) {
+			append_labelled(out, "radiance_lock_acquisitions_total", "lock", l.name, l.acquisitions);
+		}
+		append_family(out, "radiance_lock_contended", "counter", "Acquisitions that had to wait for the lock");
+		for (const lock_stats &l: locks) {
+			append_labelled(out, "radiance_lock_contended_total", "lock", l.name, l.contended);
+		}
+		append_family(out, "radiance_lock_failed_tries", "counter", "Attempts to take the lock without waiting that found it held");
+		for (const lock_stats &l: locks) {
+			append_labelled(out, "radiance_lock_failed_tries_total", "lock", l.name, l.failed_tries);
+		}
+		append_family(out, "radiance_lock_wait_seconds", "counter", "Time spent waiting for the lock");
+		for (const lock_stats &l: locks) {
+			append_labelled_seconds(out, "radiance_lock_wait_seconds_total", "lock", l.name, l.wait_ns / 1000);
+		}
+		append_family(out, "radiance_lock_max_hold_seconds", "gauge", "Longest time the lock was held since startup");
+		for (const lock_stats &l: locks) {
+			append_labelled_seconds(out, "radiance_lock_max_hold_seconds", "lock", l.name, l.max_hold_ns / 1000);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(histograms_lock());
+	for (const histogram *h: histograms()) {
+		h->render(out);
+	}
+
+	out += "# EOF\n";
+	return out;
+}
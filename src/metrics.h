@@ -0,0 +1,62 @@
+#ifndef RADIANCE_METRICS_H
+#define RADIANCE_METRICS_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+// Fixed bucket histogram. Observing is a couple of relaxed atomic adds so it
+// can sit on the request path; rendering copies the buckets out first.
+class histogram {
+	private:
+		std::string name;
+		std::string help;
+		std::vector<uint64_t> bounds; // Upper bucket bounds in microseconds
+		std::atomic<uint64_t> *buckets;
+		std::atomic<uint64_t> sum;
+
+	public:
+		histogram(const std::string &name, const std::string &help, const std::vector<uint64_t> &bounds);
+		~histogram();
+		void observe(uint64_t usecs);
+		void render(std::string &out) const;
+};
+
+// Everything a scrape needs, copied out of the shared counters in one go
+struct metrics_snapshot {
+	uint64_t uptime;
+	uint64_t start_time;
+	uint64_t open_connections;
+	uint64_t opened_connections;
+	uint64_t connection_rate;
+	uint64_t requests;
+	uint64_t request_rate;
+	uint64_t announcements;
+	uint64_t succ_announcements;
+	uint64_t scrapes;
+	uint64_t leechers;
+	uint64_t seeders;
+	uint64_t ipv4_peers;
+	uint64_t ipv6_peers;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t torrent_queue;
+	uint64_t user_queue;
+	uint64_t peer_queue;
+	uint64_t peer_hist_queue;
+	uint64_t snatch_queue;
+	uint64_t token_queue;
+	uint64_t reaper_cycles;
+	uint64_t reaper_last_slices;
+	uint64_t reaper_last_cycle_usecs;
+	uint64_t full_scrape_locked_walks;
+};
+
+void take_metrics_snapshot(metrics_snapshot &snap);
+std::string render_metrics();
+
+extern histogram request_latency;
+extern histogram reaper_slice_duration;
+
+#endif
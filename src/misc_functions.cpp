@@ -1,5 +1,7 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <string>
 #include <iostream>
 #include <sstream>
@@ -21,27 +23,79 @@ int lockRegion(int fd, int type, int whence, int start, int len) {
 	return lockReg(fd, F_SETLK, type, whence, start, len);
 }
 
-int32_t strtoint32(const std::string& str) {
-	std::istringstream stream(str);
-	int32_t i = 0;
-	stream >> i;
-	return i;
+const char * parse_int(const char *begin, const char *end, int64_t &value) {
+	const char *p = begin;
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+')) {
+		negative = *p++ == '-';
+	}
+	const char *digits = p;
+	// Accumulate negatively, the negative range is the larger one
+	int64_t result = 0;
+	bool overflow = false;
+	for (; p != end && *p >= '0' && *p <= '9'; p++) {
+		int digit = *p - '0';
+		if (result < (INT64_MIN + digit) / 10) {
+			overflow = true;
+		} else {
+			result = result * 10 - digit;
+		}
+	}
+	if (p == digits) {
+		return begin;
+	}
+	if (overflow) {
+		value = negative ? INT64_MIN : INT64_MAX;
+	} else if (negative) {
+		value = result;
+	} else {
+		value = result == INT64_MIN ? INT64_MAX : -result;
+	}
+	return p;
 }
 
-int64_t strtoint64(const std::string& str) {
-	std::istringstream stream(str);
+char * format_uint(char *out, uint64_t value) {
+	char buf[INT_BUFFER_SIZE];
+	char *p = buf + sizeof(buf);
+	do {
+		*--p = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	size_t length = buf + sizeof(buf) - p;
+	memcpy(out, p, length);
+	return out + length;
+}
+
+char * format_int(char *out, int64_t value) {
+	if (value < 0) {
+		*out++ = '-';
+		return format_uint(out, 0 - static_cast<uint64_t>(value));
+	}
+	return format_uint(out, value);
+}
+
+static int64_t strtoint(const std::string& str) {
+	const char *begin = str.data(), *end = begin + str.length();
+	while (begin != end && isspace(static_cast<unsigned char>(*begin))) {
+		begin++;
+	}
 	int64_t i = 0;
-	stream >> i;
+	parse_int(begin, end, i);
 	return i;
 }
 
+int32_t strtoint32(const std::string& str) {
+	int64_t i = strtoint(str);
+	return i > INT32_MAX ? INT32_MAX : (i < INT32_MIN ? INT32_MIN : i);
+}
+
+int64_t strtoint64(const std::string& str) {
+	return strtoint(str);
+}
 
 std::string inttostr(const int i) {
-	std::string str;
-	std::stringstream out;
-	out << i;
-	str = out.str();
-	return str;
+	char buf[INT_BUFFER_SIZE];
+	return std::string(buf, format_int(buf, i) - buf);
 }
 
 std::string hex_decode(const std::string &in) {
@@ -2,11 +2,55 @@
 #define MISC_FUNCTIONS__H
 #include <string>
 #include <vector>
+#include <type_traits>
+#include <stdint.h>
+
+// Enough for any 64 bit integer with its sign
+#define INT_BUFFER_SIZE 21
 
 int lockRegion(int fd, int type, int whence, int start, int len);
+
+/*
+ * Integer parsing and formatting on caller buffers, in the spirit of
+ * std::from_chars and std::to_chars. parse_int reads an optional sign and
+ * decimal digits and returns where it stopped, begin if there were no
+ * digits. Unlike from_chars, overflow saturates like stream extraction.
+ * format_int writes the digits to out and returns the end.
+ */
+const char * parse_int(const char *begin, const char *end, int64_t &value);
+char * format_int(char *out, int64_t value);
+char * format_uint(char *out, uint64_t value);
+inline void append_int(std::string &out, int64_t value) {
+	char buf[INT_BUFFER_SIZE];
+	out.append(buf, format_int(buf, value) - buf);
+}
+inline void append_uint(std::string &out, uint64_t value) {
+	char buf[INT_BUFFER_SIZE];
+	out.append(buf, format_uint(buf, value) - buf);
+}
+
+// Leading blanks are skipped and anything after the number is ignored
 int32_t strtoint32(const std::string& str);
 int64_t strtoint64(const std::string& str);
 std::string inttostr(int i);
+
+// Builds database records and keys like a std::stringstream, without the stream
+class string_builder {
+	private:
+		std::string buffer;
+	public:
+		string_builder() { buffer.reserve(128); }
+		inline string_builder & operator<<(char c) { buffer.push_back(c); return *this; }
+		inline string_builder & operator<<(const char *s) { buffer.append(s); return *this; }
+		inline string_builder & operator<<(const std::string &s) { buffer.append(s); return *this; }
+		template <typename T>
+		inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, string_builder &>::type
+		operator<<(T value) { append_int(buffer, value); return *this; }
+		template <typename T>
+		inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, string_builder &>::type
+		operator<<(T value) { append_uint(buffer, value); return *this; }
+		inline std::string & str() { return buffer; }
+};
 std::string hex_decode(const std::string &in);
 std::string bintohex(const std::string &in);
 std::string trim(const std::string &str);
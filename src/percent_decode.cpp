@@ -0,0 +1,155 @@
+#include <string>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PERCENT_DECODE_X86
+#endif
+
+#include "percent_decode.h"
+
+#define HASH_LENGTH 20
+#define MAX_ENCODED_LENGTH (3 * HASH_LENGTH)
+#define PADDED_LENGTH 64
+
+// '%' at every third position of a fully escaped hash
+#define FULLY_ESCAPED_PERCENT 0x0249249249249249ULL
+#define FULLY_ESCAPED_ALL     0x0FFFFFFFFFFFFFFFULL
+
+// Every input byte classified, bit i of the masks is byte i
+struct classified {
+	uint64_t percent;
+	uint64_t hex;
+	uint8_t nibble[PADDED_LENGTH]; // Value of each hex digit, anything for other bytes
+};
+
+typedef void (*classify_fn)(const uint8_t *in, classified &c);
+
+static void classify_scalar(const uint8_t *in, classified &c) {
+	c.percent = 0;
+	c.hex = 0;
+	for (unsigned int i = 0; i < PADDED_LENGTH; i++) {
+		uint8_t ch = in[i];
+		uint8_t lower = ch | 0x20;
+		if (ch >= '0' && ch <= '9') {
+			c.nibble[i] = ch - '0';
+			c.hex |= 1ULL << i;
+		} else if (lower >= 'a' && lower <= 'f') {
+			c.nibble[i] = lower - 'a' + 10;
+			c.hex |= 1ULL << i;
+		} else if (ch == '%') {
+			c.percent |= 1ULL << i;
+		}
+	}
+}
+
+#if defined(PERCENT_DECODE_X86)
+// Signed compares only, so shift the range to start at -128
+#define IN_RANGE_128(v, lo, n) _mm_cmplt_epi8(_mm_sub_epi8(v, _mm_set1_epi8((char)((lo) + 128))), _mm_set1_epi8((char)(-128 + (n))))
+#define IN_RANGE_256(v, lo, n) _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + (n))), _mm256_sub_epi8(v, _mm256_set1_epi8((char)((lo) + 128))))
+
+__attribute__((target("sse2")))
+static void classify_sse2(const uint8_t *in, classified &c) {
+	c.percent = 0;
+	c.hex = 0;
+	for (unsigned int i = 0; i < PADDED_LENGTH; i += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		__m128i digit = IN_RANGE_128(v, '0', 10);
+		__m128i alpha = IN_RANGE_128(lower, 'a', 6);
+		__m128i nibble = _mm_or_si128(
+			_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+			_mm_andnot_si128(digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(c.nibble + i), nibble);
+		c.hex |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_or_si128(digit, alpha))) << i;
+		c.percent |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')))) << i;
+	}
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const uint8_t *in, classified &c) {
+	c.percent = 0;
+	c.hex = 0;
+	for (unsigned int i = 0; i < PADDED_LENGTH; i += 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+		__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		__m256i digit = IN_RANGE_256(v, '0', 10);
+		__m256i alpha = IN_RANGE_256(lower, 'a', 6);
+		__m256i nibble = _mm256_blendv_epi8(_mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10)),
+			_mm256_sub_epi8(v, _mm256_set1_epi8('0')), digit);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(c.nibble + i), nibble);
+		c.hex |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)))) << i;
+		c.percent |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('%'))))) << i;
+	}
+}
+#endif
+
+static classify_fn select_classify(const char **name) {
+#if defined(PERCENT_DECODE_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		*name = "avx2";
+		return classify_avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		*name = "sse2";
+		return classify_sse2;
+	}
+#endif
+	*name = "scalar";
+	return classify_scalar;
+}
+
+static const char *impl_name;
+static classify_fn classify() {
+	static const classify_fn fn = select_classify(&impl_name);
+	return fn;
+}
+
+const char * hash_decode_impl() {
+	classify();
+	return impl_name;
+}
+
+bool hash_decode(const std::string &in, char *out) {
+	size_t length = in.length();
+	if (length < HASH_LENGTH || length > MAX_ENCODED_LENGTH) {
+		return false;
+	}
+	// Zero padding is neither '%' nor hex, so it never validates anything
+	uint8_t padded[PADDED_LENGTH] = {};
+	memcpy(padded, in.data(), length);
+	classified c;
+	classify()(padded, c);
+
+	if (length == MAX_ENCODED_LENGTH) {
+		// Only the fully escaped form is this long
+		if (c.percent != FULLY_ESCAPED_PERCENT || (c.percent | c.hex) != FULLY_ESCAPED_ALL) {
+			return false;
+		}
+		for (unsigned int i = 0; i < HASH_LENGTH; i++) {
+			out[i] = (c.nibble[3 * i + 1] << 4) | c.nibble[3 * i + 2];
+		}
+		return true;
+	}
+
+	// Mixed literal and escaped bytes
+	unsigned int decoded = 0;
+	for (unsigned int i = 0; i < length; decoded++) {
+		if (decoded == HASH_LENGTH) {
+			return false;
+		}
+		if ((c.percent >> i) & 1) {
+			if (((c.hex >> (i + 1)) & 3) != 3) {
+				return false;
+			}
+			out[decoded] = (c.nibble[i + 1] << 4) | c.nibble[i + 2];
+			i += 3;
+		} else {
+			out[decoded] = padded[i];
+			i++;
+		}
+	}
+	return decoded == HASH_LENGTH;
+}
@@ -0,0 +1,19 @@
+#ifndef RADIANCE_PERCENT_DECODE_H
+#define RADIANCE_PERCENT_DECODE_H
+
+#include <string>
+
+/*
+ * Strict percent-decoding of info_hash and peer_id parameters, which must
+ * decode to exactly 20 bytes. Input with a truncated or non-hex escape, or
+ * that decodes to any other length, is rejected rather than turned into
+ * whatever bytes hex_decode happens to produce.
+ *
+ * On x86 the input is classified with SSE2 or AVX2, chosen at runtime,
+ * and the common fully escaped form is then decoded without branches.
+ */
+bool hash_decode(const std::string &in, char *out);
+
+// The classifier in use: "avx2", "sse2" or "scalar"
+const char * hash_decode_impl();
+#endif
@@ -0,0 +1,317 @@
+#include <mutex>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <new>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "pool.h"
+#include "logger.h"
+
+struct region_kind {
+	char *next = nullptr; // Unused part of the last region
+	char *end = nullptr;
+	std::vector<void*> free_slabs;
+};
+
+struct region_state {
+	std::mutex lock;
+	huge_page_mode mode = HUGE_PAGES_OFF;
+	region_kind kinds[2]; // Normal and huge pages, so switching modes doesn't mix them
+	std::unordered_set<uintptr_t> huge_regions;
+	std::unordered_map<void*, size_t> large;
+	size_t mapped = 0, huge = 0, slabs_out = 0, fixed = 0, large_bytes = 0;
+};
+
+// Never destroyed, static containers free their nodes after static destructors ran
+static region_state &regions() {
+	static region_state *state = new region_state;
+	return *state;
+}
+
+bool parse_huge_page_mode(const std::string &name, huge_page_mode &mode) {
+	if (name == "off") {
+		mode = HUGE_PAGES_OFF;
+	} else if (name == "transparent") {
+		mode = HUGE_PAGES_TRANSPARENT;
+	} else if (name == "hugetlb") {
+		mode = HUGE_PAGES_HUGETLB;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void set_huge_page_mode(huge_page_mode mode) {
+	region_state &r = regions();
+	std::lock_guard<std::mutex> lock(r.lock);
+	r.mode = mode;
+}
+
+// Maps length bytes at a multiple of alignment. Returns nullptr when the
+// reserved huge pages can't cover a hugetlb mapping.
+static char *map_aligned(size_t length, size_t alignment, bool hugetlb) {
+	// Reserve room to align in, then map the aligned part for real
+	size_t reserved = length + alignment;
+	void *p = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+	char *start = static_cast<char*>(p);
+	char *aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(start) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+	if (aligned != start) {
+		munmap(start, aligned - start);
+	}
+	munmap(aligned + length, start + reserved - (aligned + length));
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | (hugetlb ? MAP_HUGETLB : 0);
+	if (mmap(aligned, length, PROT_READ | PROT_WRITE, flags, -1, 0) == MAP_FAILED) {
+		munmap(aligned, length);
+		if (hugetlb) {
+			return nullptr;
+		}
+		throw std::bad_alloc();
+	}
+	return aligned;
+}
+
+// Called with the region lock held, returns the kind the new region went to
+static region_kind &map_region(region_state &r) {
+	char *region = nullptr;
+	if (r.mode == HUGE_PAGES_HUGETLB) {
+		region = map_aligned(SLAB_REGION_SIZE, SLAB_REGION_SIZE, true);
+		if (region == nullptr) {
+			syslog(warning) << "Not enough reserved huge pages for another region, using transparent huge pages";
+			r.mode = HUGE_PAGES_TRANSPARENT;
+		}
+	}
+	if (region == nullptr) {
+		region = map_aligned(SLAB_REGION_SIZE, SLAB_REGION_SIZE, false);
+		if (r.mode == HUGE_PAGES_TRANSPARENT && madvise(region, SLAB_REGION_SIZE, MADV_HUGEPAGE) != 0) {
+			syslog(warning) << "Transparent huge pages are unavailable (" << strerror(errno) << "), using normal pages";
+			r.mode = HUGE_PAGES_OFF;
+		}
+	}
+	r.mapped += SLAB_REGION_SIZE;
+	if (r.mode != HUGE_PAGES_OFF) {
+		r.huge_regions.insert(reinterpret_cast<uintptr_t>(region));
+		r.huge += SLAB_REGION_SIZE;
+	}
+	region_kind &kind = r.kinds[r.mode != HUGE_PAGES_OFF];
+	kind.next = region;
+	kind.end = region + SLAB_REGION_SIZE;
+	return kind;
+}
+
+void * slab_alloc() {
+	region_state &r = regions();
+	std::lock_guard<std::mutex> lock(r.lock);
+	r.slabs_out++;
+	region_kind *kind = &r.kinds[r.mode != HUGE_PAGES_OFF];
+	if (!kind->free_slabs.empty()) {
+		void *slab = kind->free_slabs.back();
+		kind->free_slabs.pop_back();
+		return slab;
+	}
+	if (kind->next == kind->end) {
+		kind = &map_region(r);
+	}
+	void *slab = kind->next;
+	kind->next += SLAB_SIZE;
+	return slab;
+}
+
+void slab_free(void *slab) {
+	region_state &r = regions();
+	uintptr_t region = reinterpret_cast<uintptr_t>(slab) & ~static_cast<uintptr_t>(SLAB_REGION_SIZE - 1);
+	std::lock_guard<std::mutex> lock(r.lock);
+	bool huge = r.huge_regions.count(region) != 0;
+	if (!huge) {
+		// Reading it again gives zero filled pages
+		madvise(slab, SLAB_SIZE, MADV_DONTNEED);
+	}
+	r.slabs_out--;
+	r.kinds[huge].free_slabs.push_back(slab);
+}
+
+void * region_alloc(size_t bytes) {
+	bytes = (bytes + SLAB_SIZE - 1) & ~static_cast<size_t>(SLAB_SIZE - 1);
+	if (bytes > SLAB_REGION_SIZE) {
+		throw std::bad_alloc();
+	}
+	region_state &r = regions();
+	std::lock_guard<std::mutex> lock(r.lock);
+	region_kind *kind = &r.kinds[r.mode != HUGE_PAGES_OFF];
+	if (static_cast<size_t>(kind->end - kind->next) < bytes) {
+		// The rest of the region is still good for single slabs
+		for (; kind->next != kind->end; kind->next += SLAB_SIZE) {
+			kind->free_slabs.push_back(kind->next);
+		}
+		kind = &map_region(r);
+	}
+	void *p = kind->next;
+	kind->next += bytes;
+	r.fixed += bytes;
+	return p;
+}
+
+void * large_alloc(size_t bytes) {
+	region_state &r = regions();
+	std::lock_guard<std::mutex> lock(r.lock);
+	if (r.mode == HUGE_PAGES_OFF) {
+		return ::operator new(bytes);
+	}
+	size_t length = (bytes + HUGE_PAGE_SIZE - 1) & ~static_cast<size_t>(HUGE_PAGE_SIZE - 1);
+	char *p = nullptr;
+	if (r.mode == HUGE_PAGES_HUGETLB) {
+		p = map_aligned(length, HUGE_PAGE_SIZE, true);
+	}
+	if (p == nullptr) {
+		p = map_aligned(length, HUGE_PAGE_SIZE, false);
+		madvise(p, length, MADV_HUGEPAGE);
+	}
+	r.large[p] = length;
+	r.large_bytes += length;
+	return p;
+}
+
+void large_free(void *p) {
+	region_state &r = regions();
+	{
+		std::lock_guard<std::mutex> lock(r.lock);
+		auto mapping = r.large.find(p);
+		if (mapping != r.large.end()) {
+			munmap(p, mapping->second);
+			r.large_bytes -= mapping->second;
+			r.large.erase(mapping);
+			return;
+		}
+	}
+	// From before huge pages were turned on
+	::operator delete(p);
+}
+
+slab_stats get_slab_stats() {
+	region_state &r = regions();
+	std::lock_guard<std::mutex> lock(r.lock);
+	return {r.mapped, r.huge, r.slabs_out, r.kinds[0].free_slabs.size() + r.kinds[1].free_slabs.size(), r.fixed, r.large_bytes};
+}
+
+slab_pool::slab_pool(size_t size) : spare(nullptr), slabs(0), objects(0) {
+	object_size = pool_object_size(size);
+	first_object = pool_object_size(sizeof(slab));
+	per_slab = (SLAB_SIZE - first_object) / object_size;
+	for (unsigned int i = 0; i < POOL_BINS; i++) {
+		bins[i] = nullptr;
+	}
+}
+
+// Only for slabs that are neither empty nor full
+void slab_pool::link(slab *s) {
+	slab *&head = bins[bin(s->in_use)];
+	s->prev = nullptr;
+	s->next = head;
+	if (head != nullptr) {
+		head->prev = s;
+	}
+	head = s;
+}
+
+void slab_pool::unlink(slab *s) {
+	if (s->prev != nullptr) {
+		s->prev->next = s->next;
+	} else {
+		bins[bin(s->in_use)] = s->next;
+	}
+	if (s->next != nullptr) {
+		s->next->prev = s->prev;
+	}
+}
+
+void * slab_pool::allocate() {
+	std::lock_guard<std::mutex> guard(lock);
+	slab *s = nullptr;
+	for (int i = POOL_BINS - 1; i >= 0 && s == nullptr; i--) {
+		s = bins[i];
+	}
+	if (s != nullptr) {
+		unlink(s);
+	} else if (spare != nullptr) {
+		s = spare;
+		spare = nullptr;
+	} else {
+		s = static_cast<slab*>(slab_alloc());
+		s->free_list = nullptr;
+		s->unused = reinterpret_cast<char*>(s) + first_object;
+		s->in_use = 0;
+		slabs++;
+	}
+	void *p;
+	if (s->free_list != nullptr) {
+		p = s->free_list;
+		s->free_list = *static_cast<void**>(p);
+	} else {
+		// Carved as needed so a new slab's pages are only touched when used
+		p = s->unused;
+		s->unused += object_size;
+	}
+	if (++s->in_use != per_slab) {
+		link(s);
+	}
+	objects++;
+	return p;
+}
+
+void slab_pool::deallocate(void *p) {
+	slab *s = reinterpret_cast<slab*>(reinterpret_cast<uintptr_t>(p) & ~static_cast<uintptr_t>(SLAB_SIZE - 1));
+	std::lock_guard<std::mutex> guard(lock);
+	*static_cast<void**>(p) = s->free_list;
+	s->free_list = p;
+	objects--;
+	if (s->in_use != per_slab) {
+		unlink(s);
+	}
+	if (--s->in_use != 0) {
+		link(s);
+	} else if (spare == nullptr) {
+		spare = s;
+	} else {
+		slabs--;
+		slab_free(s);
+	}
+}
+
+pool_stats slab_pool::stats() {
+	std::lock_guard<std::mutex> guard(lock);
+	return {object_size, slabs, objects};
+}
+
+#define POOL_SIZE_CLASSES (POOL_MAX_OBJECT / POOL_SIZE_STEP)
+
+// Created on first use and never destroyed, for the same reason
+static slab_pool **size_classes() {
+	static slab_pool **pools = []() {
+		slab_pool **list = new slab_pool*[POOL_SIZE_CLASSES];
+		for (size_t i = 0; i < POOL_SIZE_CLASSES; i++) {
+			list[i] = new slab_pool((i + 1) * POOL_SIZE_STEP);
+		}
+		return list;
+	}();
+	return pools;
+}
+
+slab_pool & size_class_pool(size_t size) {
+	return *size_classes()[(size - 1) / POOL_SIZE_STEP];
+}
+
+std::vector<pool_stats> get_pool_stats() {
+	std::vector<pool_stats> result;
+	for (size_t i = 0; i < POOL_SIZE_CLASSES; i++) {
+		pool_stats s = size_classes()[i]->stats();
+		if (s.slabs != 0) {
+			result.push_back(s);
+		}
+	}
+	return result;
+}
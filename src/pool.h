@@ -0,0 +1,147 @@
+#ifndef RADIANCE_POOL_H
+#define RADIANCE_POOL_H
+
+#include <mutex>
+#include <vector>
+#include <string>
+#include <new>
+#include <cstddef>
+#include <stdint.h>
+
+#define SLAB_SIZE        (64 << 10) // Slabs are aligned to their size
+#define SLAB_REGION_SIZE (32 << 20) // Slabs are carved out of regions this big, aligned to it
+#define HUGE_PAGE_SIZE   (2 << 20)
+#define POOL_SIZE_STEP   16
+#define POOL_MAX_OBJECT  1024       // Anything bigger goes to operator new
+#define POOL_BINS        8          // Slabs with room, grouped by how full they are
+
+/*
+ * How new regions are backed, see huge_pages in radiance.conf. Peers,
+ * torrents and the user arena all live in regions, so with huge pages a
+ * 2 MB TLB entry covers what would otherwise take 512.
+ */
+enum huge_page_mode {
+	HUGE_PAGES_OFF,
+	HUGE_PAGES_TRANSPARENT, // madvise(MADV_HUGEPAGE), the kernel backs them when it can
+	HUGE_PAGES_HUGETLB      // MAP_HUGETLB from the reserved pool, transparent if that's empty
+};
+bool parse_huge_page_mode(const std::string &name, huge_page_mode &mode);
+// Only regions mapped from then on are affected, so set it before loading the lists
+void set_huge_page_mode(huge_page_mode mode);
+
+/*
+ * Slabs for the pools below. They come out of large anonymous mappings so
+ * the process doesn't end up with one mapping per slab. A freed slab is
+ * madvise()d away, giving its memory back to the kernel, and reused for
+ * the next slab any pool needs. The address space itself is kept. Slabs in
+ * huge page regions keep their memory, giving back part of a huge page
+ * would split it.
+ */
+void * slab_alloc();
+void slab_free(void *slab);
+
+// Whole slabs in a row for memory that is never freed, like user arena chunks
+void * region_alloc(size_t bytes);
+
+// Arrays of at least HUGE_PAGE_SIZE, hash table buckets of big tables. They
+// get their own mapping when huge pages are on and come from operator new otherwise.
+void * large_alloc(size_t bytes);
+void large_free(void *p);
+
+// Totals for report?get=memory
+struct slab_stats {
+	size_t mapped;     // Bytes of address space in regions
+	size_t huge;       // Of those, in huge page regions
+	size_t slabs;      // Slabs handed out to pools
+	size_t free_slabs; // Released and waiting for reuse
+	size_t fixed;      // Bytes handed out by region_alloc
+	size_t large;      // Bytes in large_alloc mappings
+};
+slab_stats get_slab_stats();
+
+struct pool_stats {
+	size_t object_size;
+	size_t slabs;
+	size_t objects;
+};
+
+/*
+ * Fixed size objects out of slabs. Each slab keeps its own free list and
+ * count. Objects are always taken from the fullest slabs with room, so
+ * after a peak the sparse slabs get no new objects, drain as their peers
+ * leave and are released once empty. Peer churn then reuses the same
+ * memory instead of fragmenting the heap, and RSS follows the number of
+ * live objects rather than the peak.
+ */
+class slab_pool {
+	private:
+		struct slab {
+			slab *prev; // In its bin
+			slab *next;
+			void *free_list;
+			char *unused; // Objects past this were never handed out
+			uint32_t in_use;
+		};
+		std::mutex lock;
+		size_t object_size;
+		uint32_t per_slab;
+		size_t first_object; // Offset past the slab header
+		slab *bins[POOL_BINS]; // Slabs with room by in_use, empty and full ones aren't in any
+		slab *spare;           // One empty slab kept back so churn at a boundary doesn't thrash
+		size_t slabs;
+		size_t objects;
+
+		inline unsigned int bin(uint32_t in_use) const { return in_use * POOL_BINS / per_slab; }
+		void link(slab *s);
+		void unlink(slab *s);
+
+	public:
+		explicit slab_pool(size_t size);
+		slab_pool(const slab_pool&) = delete;
+		slab_pool& operator=(const slab_pool&) = delete;
+		void * allocate();
+		void deallocate(void *p);
+		pool_stats stats();
+};
+
+// The pool for objects of the given size, sizes are rounded up to POOL_SIZE_STEP
+slab_pool & size_class_pool(size_t size);
+inline size_t pool_object_size(size_t size) {
+	return (size + POOL_SIZE_STEP - 1) & ~static_cast<size_t>(POOL_SIZE_STEP - 1);
+}
+std::vector<pool_stats> get_pool_stats();
+
+/*
+ * Allocator for node based containers: single objects come from the size
+ * class pool, arrays (hash table buckets) from operator new or large_alloc.
+ */
+template <typename T> class pool_allocator {
+	public:
+		typedef T value_type;
+
+		pool_allocator() noexcept {}
+		template <typename U> pool_allocator(const pool_allocator<U>&) noexcept {}
+
+		T * allocate(size_t n) {
+			if (n == 1 && sizeof(T) <= POOL_MAX_OBJECT && alignof(T) <= POOL_SIZE_STEP) {
+				return static_cast<T*>(size_class_pool(sizeof(T)).allocate());
+			} else if (n * sizeof(T) >= HUGE_PAGE_SIZE) {
+				return static_cast<T*>(large_alloc(n * sizeof(T)));
+			}
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+		void deallocate(T *p, size_t n) {
+			if (n == 1 && sizeof(T) <= POOL_MAX_OBJECT && alignof(T) <= POOL_SIZE_STEP) {
+				size_class_pool(sizeof(T)).deallocate(p);
+			} else if (n * sizeof(T) >= HUGE_PAGE_SIZE) {
+				large_free(p);
+			} else {
+				::operator delete(p);
+			}
+		}
+
+		template <typename U> struct rebind { typedef pool_allocator<U> other; };
+		template <typename U> bool operator==(const pool_allocator<U>&) const noexcept { return true; }
+		template <typename U> bool operator!=(const pool_allocator<U>&) const noexcept { return false; }
+};
+#endif
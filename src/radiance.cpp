@@ -8,6 +8,7 @@
 #include "../autoconf.h"
 #include "radiance.h"
 #include "database.h"
+#include "domain.h"
 #include "worker.h"
 #include "events.h"
 #include "schedule.h"
@@ -16,6 +17,7 @@
 #include "debug.h"
 #include "config.h"
 #include "logger.h"
+#include "thread_role.h"
 
 static connection_mother *mother;
 static worker *work;
@@ -96,7 +98,18 @@ static void sig_handler(int sig) {
 		if (work->shutdown()) {
 			exit(EXIT_SUCCESS);
 		}
-	} else if (sig == SIGHUP) {
+#if defined(__DEBUG_BUILD__)
+	}  else if (sig == SIGSEGV) {
+		// print out all the frames to stderr
+		syslog(fatal) << "SegFault:" << '\n' << backtrace(1);
+		exit(EXIT_FAILURE);
+#endif
+	}
+}
+
+// Delivered through the event loop, reloading takes locks and frees retired configs
+static void handle_reload_signal(ev::sig &watcher, int events_flags) {
+	if (watcher.signum == SIGHUP) {
 		syslog(info) << "Reloading config";
 		conf->reload();
 		// Reinitialize logger
@@ -105,21 +118,17 @@ static void sig_handler(int sig) {
 		mother->reload_config();
 		sc->reload_config();
 		sched->reload_config();
-		work->reload_config();
 		syslog(info) << "Done reloading config";
-	} else if (sig == SIGUSR1) {
+	} else if (watcher.signum == SIGUSR1) {
 		syslog(info) << "Reloading from database";
-		std::thread w_thread(&worker::reload_lists, work);
+		std::thread w_thread([]() {
+			enter_thread_role(ROLE_RELOAD, "reload");
+			work->reload_lists();
+		});
 		w_thread.detach();
-	} else if (sig == SIGUSR2) {
+	} else if (watcher.signum == SIGUSR2) {
 		// Reinitialize logger
 		rotate_log();
-#if defined(__DEBUG_BUILD__)
-	}  else if (sig == SIGSEGV) {
-		// print out all the frames to stderr
-		syslog(fatal) << "SegFault:" << '\n' << backtrace(1);
-		exit(EXIT_FAILURE);
-#endif
 	}
 }
 
@@ -162,7 +171,15 @@ int main(int argc, char **argv) {
 	// Start logger
 	init_log();
 
-	if (conf->get_bool("daemonize") || daemonize) {
+	bool conf_daemonize;
+	std::string pid_file;
+	{
+		rcu_read_guard guard;
+		conf_daemonize = conf->get()->daemonize;
+		pid_file = conf->get()->pid_file;
+	}
+
+	if (conf_daemonize || daemonize) {
 		syslog(info) << "Running in Daemon Mode";
 		pid_t pid, sid;
 		pid = fork();
@@ -192,8 +209,18 @@ int main(int argc, char **argv) {
 		syslog(info) << "Running in Foreground";
 	}
 
-	if (conf->get_str("pid_file") != "none") {
-		createPidFile("radiance", conf->get_str("pid_file").c_str(), LOCK_EX | LOCK_NB);
+	if (pid_file != "none") {
+		createPidFile("radiance", pid_file.c_str(), LOCK_EX | LOCK_NB);
+	}
+
+	{
+		rcu_read_guard guard;
+		huge_page_mode mode;
+		if (parse_huge_page_mode(conf->get()->huge_pages, mode)) {
+			set_huge_page_mode(mode);
+		} else {
+			syslog(error) << "Invalid huge_pages setting \"" << conf->get()->huge_pages << "\", using normal pages";
+		}
 	}
 
 	db = new database();
@@ -202,11 +229,12 @@ int main(int argc, char **argv) {
 	users_list    = new user_list;
 	torrents_list = new torrent_list;
 	domains_list  = new domain_list;
-	std::vector<std::string> blacklist;
+	client_blacklist blacklist;
 
 	db->load_site_options();
-	db->load_users(*users_list);
-	db->load_torrents(*torrents_list);
+	std::vector<user_ptr> removed_users; // Nothing to remove on the first load
+	db->load_users(*users_list, removed_users);
+	db->load_torrents(*torrents_list, *domains_list);
 	db->load_tokens(*torrents_list);
 	db->load_peers(*torrents_list, *users_list);
 	db->load_blacklist(blacklist);
@@ -230,6 +258,10 @@ int main(int argc, char **argv) {
 	stats.peer_hist_queue = 0;
 	stats.snatch_queue = 0;
 	stats.token_queue = 0;
+	stats.reaper_cycles = 0;
+	stats.reaper_last_slices = 0;
+	stats.reaper_last_cycle_usecs = 0;
+	stats.full_scrape_locked_walks = 0;
 
 	stats.start_time = time(NULL);
 
@@ -250,11 +282,18 @@ int main(int argc, char **argv) {
 
 	sigaction(SIGINT,  &handler, NULL);
 	sigaction(SIGTERM, &handler, NULL);
-	sigaction(SIGHUP,  &handler, NULL);
-	sigaction(SIGUSR1, &handler, NULL);
-	sigaction(SIGUSR2, &handler, NULL);
 	sigaction(SIGSEGV, &handler, NULL);
 
+	ev::sig hup_event, usr1_event, usr2_event;
+	hup_event.set<handle_reload_signal>();
+	hup_event.start(SIGHUP);
+	usr1_event.set<handle_reload_signal>();
+	usr1_event.start(SIGUSR1);
+	usr2_event.set<handle_reload_signal>();
+	usr2_event.start(SIGUSR2);
+
+	// Named after the process so ps and top still show radiance
+	enter_thread_role(ROLE_EVENT_LOOP, "radiance");
 	mother->run();
 
 	return 0;
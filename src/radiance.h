@@ -17,14 +17,29 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include "timing_wheel.h"
+#include "pool.h"
+
 typedef uint32_t torid_t;
 typedef uint32_t userid_t;
 
 class user;
-typedef std::shared_ptr<user> user_ptr;
+typedef user * user_ptr; // Owned by user_arena
+
+// A user as peers see it, resolved through user_arena::get. The generation
+// no longer matches once the user is removed, so stale references just miss.
+struct user_ref {
+	uint32_t index;
+	uint32_t generation; // 0 is never handed out
+	user_ref() : index(0), generation(0) {}
+	user_ref(uint32_t i, uint32_t g) : index(i), generation(g) {}
+	bool operator==(const user_ref &other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const user_ref &other) const { return !(*this == other); }
+};
 
-class domain;
-typedef std::shared_ptr<domain> domain_ptr;
+typedef uint32_t domain_id; // See domain_list
+#define DOMAIN_NONE 0xFFFFFFFF // Peers loaded from the database aren't counted anywhere
+class domain_list;
 
 class settings;
 extern settings *conf;
@@ -32,7 +47,22 @@ extern settings *conf;
 class options;
 extern options  *opts;
 
-typedef struct {
+struct peer;
+struct torrent;
+
+// Where an expiring peer lives, see worker::reap_peers
+struct peer_hook : wheel_hook {
+	torrent *tor = nullptr;
+	std::pair<const std::string, peer> *entry = nullptr;
+};
+
+// Where an expiring token lives
+struct token_hook : wheel_hook {
+	torrent *tor = nullptr;
+	int userid = 0;
+};
+
+struct peer {
 	int64_t uploaded;
 	int64_t downloaded;
 	int64_t corrupt;
@@ -43,26 +73,39 @@ typedef struct {
 	uint16_t port;
 	bool visible;
 	bool paused;
-	user_ptr user;
-	domain_ptr domain;
+	user_ref user;
+	domain_id domain = DOMAIN_NONE;
 	std::string ipv4;
 	std::string ipv4_port;
 	std::string ipv6;
 	std::string ipv6_port;
-} peer;
+	peer_hook expiry;
+};
 
-typedef std::unordered_map<std::string, peer> peer_list;
+// Nodes come from size class pools, peers churn more than anything else
+typedef std::unordered_map<std::string, peer, std::hash<std::string>, std::equal_to<std::string>,
+	pool_allocator<std::pair<const std::string, peer>>> peer_list;
 
 enum freetype { NORMAL, FREE, DOUBLE, NEUTRAL };
 
 typedef struct {
 	time_t free_leech;
 	time_t double_seed;
+	token_hook expiry;
 } slots_t;
 
 typedef std::map<int, slots_t> slots_list;
 
+// Bencoded scrape entry of a torrent and the counts it was built from
 typedef struct {
+	size_t seeders;
+	size_t leechers;
+	uint32_t completed;
+	uint32_t paused;
+	std::string fragment;
+} scrape_cache_t;
+
+struct torrent {
 	torid_t id;
 	uint32_t completed;
 	uint32_t paused;
@@ -75,7 +118,8 @@ typedef struct {
 	std::string last_selected_seeder;
 	std::string last_selected_leecher;
 	std::map<int, slots_t> tokened_users;
-} torrent;
+	scrape_cache_t scrape_cache;
+};
 
 enum {
 	DUPE, // 0
@@ -103,21 +147,17 @@ enum {
 	AUDIENCE // 22
 };
 
-typedef struct {
-	int reason;
-	time_t time;
-} del_message;
-
 typedef struct {
 	bool gzip;
 	bool html;
 	bool json;
+	bool openmetrics;
 	bool http_close;
 } client_opts_t;
 
-typedef std::unordered_map<std::string, torrent> torrent_list;
+typedef std::unordered_map<std::string, torrent, std::hash<std::string>, std::equal_to<std::string>,
+	pool_allocator<std::pair<const std::string, torrent>>> torrent_list;
 typedef std::unordered_map<std::string, user_ptr> user_list;
-typedef std::unordered_map<std::string, domain_ptr> domain_list;
 typedef std::unordered_map<std::string, std::string> params_type;
 
 
@@ -142,6 +182,10 @@ struct stats_t {
 	std::atomic<uint64_t> peer_hist_queue;
 	std::atomic<uint64_t> snatch_queue;
 	std::atomic<uint64_t> token_queue;
+	std::atomic<uint64_t> reaper_cycles;
+	std::atomic<uint64_t> reaper_last_slices;
+	std::atomic<uint64_t> reaper_last_cycle_usecs;
+	std::atomic<uint64_t> full_scrape_locked_walks;
 	time_t start_time;
 };
 extern struct stats_t stats;
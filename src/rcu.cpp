@@ -0,0 +1,126 @@
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <stdint.h>
+
+#include "rcu.h"
+
+// Epoch 0 marks an idle slot, so the global epoch starts at 1
+static std::atomic<uint64_t> global_epoch(1);
+
+struct reader_slot {
+	std::atomic<uint64_t> epoch;
+	std::atomic<bool> in_use;
+	unsigned int depth; // Only touched by the owning thread
+};
+
+struct retired {
+	uint64_t epoch;
+	std::function<void()> deleter;
+};
+
+// Slots are never freed, threads that exit hand theirs back for reuse.
+// The schedule spawns short lived flush threads, so this stays small.
+static std::mutex &slots_lock() {
+	static std::mutex lock;
+	return lock;
+}
+static std::vector<reader_slot*> &slots() {
+	static std::vector<reader_slot*> list;
+	return list;
+}
+
+static std::mutex &retired_lock() {
+	static std::mutex lock;
+	return lock;
+}
+static std::deque<retired> &retired_list() {
+	static std::deque<retired> list;
+	return list;
+}
+
+static reader_slot *acquire_slot() {
+	std::lock_guard<std::mutex> lock(slots_lock());
+	for (reader_slot *slot: slots()) {
+		bool expected = false;
+		if (slot->in_use.compare_exchange_strong(expected, true)) {
+			return slot;
+		}
+	}
+	reader_slot *slot = new reader_slot;
+	slot->epoch = 0;
+	slot->in_use = true;
+	slot->depth = 0;
+	slots().push_back(slot);
+	return slot;
+}
+
+class thread_slot {
+	public:
+		reader_slot *slot;
+		thread_slot() : slot(acquire_slot()) {}
+		~thread_slot() {
+			slot->epoch.store(0, std::memory_order_release);
+			slot->in_use.store(false, std::memory_order_release);
+		}
+};
+
+static inline reader_slot *local_slot() {
+	static thread_local thread_slot local;
+	return local.slot;
+}
+
+rcu_read_guard::rcu_read_guard() {
+	reader_slot *slot = local_slot();
+	if (slot->depth++ == 0) {
+		slot->epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		// Pairs with the fence in rcu_reclaim: either the writer sees this
+		// slot or this reader sees everything published before the scan
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
+
+rcu_read_guard::~rcu_read_guard() {
+	reader_slot *slot = local_slot();
+	if (--slot->depth == 0) {
+		slot->epoch.store(0, std::memory_order_release);
+	}
+}
+
+void rcu_retire(std::function<void()> deleter) {
+	std::lock_guard<std::mutex> lock(retired_lock());
+	retired_list().push_back({global_epoch.load(std::memory_order_seq_cst), std::move(deleter)});
+}
+
+void rcu_reclaim() {
+	// Readers entering from now on can't see anything retired so far
+	global_epoch.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	uint64_t oldest = UINT64_MAX;
+	{
+		std::lock_guard<std::mutex> lock(slots_lock());
+		for (const reader_slot *slot: slots()) {
+			uint64_t epoch = slot->epoch.load(std::memory_order_acquire);
+			if (epoch != 0 && epoch < oldest) {
+				oldest = epoch;
+			}
+		}
+	}
+
+	std::vector<std::function<void()>> ready;
+	{
+		std::lock_guard<std::mutex> lock(retired_lock());
+		auto &list = retired_list();
+		while (!list.empty() && list.front().epoch < oldest) {
+			ready.push_back(std::move(list.front().deleter));
+			list.pop_front();
+		}
+	}
+	// Deleters run outside the lock, they may retire more objects
+	for (auto &deleter: ready) {
+		deleter();
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef RADIANCE_RCU_H
+#define RADIANCE_RCU_H
+
+#include <atomic>
+#include <functional>
+
+/*
+ * Minimal epoch based read-copy-update.
+ *
+ * Readers wrap their accesses in an rcu_read_guard. Worker::work holds one
+ * for the whole request, so anything read through an rcu_ptr during a
+ * request is a single pointer load. Other threads take their own guard.
+ * Guards nest. Writers never wait for readers, so a guard may be held while
+ * waiting for a lock; it only keeps objects retired since it was taken from
+ * being deleted until it is left, so a guard held for long only costs memory.
+ *
+ * Writers build a new object, publish() it and the old one is deleted once
+ * every reader that could still see it has left its guard. Concurrent
+ * writers to the same rcu_ptr must be serialised by the caller.
+ */
+class rcu_read_guard {
+	public:
+		rcu_read_guard();
+		~rcu_read_guard();
+		rcu_read_guard(const rcu_read_guard&) = delete;
+		rcu_read_guard& operator=(const rcu_read_guard&) = delete;
+};
+
+// Run deleter once no reader that started before this call is left
+void rcu_retire(std::function<void()> deleter);
+
+// Run the deleters that are safe to run now, called by writers and the schedule
+void rcu_reclaim();
+
+template <typename T> class rcu_ptr {
+	private:
+		std::atomic<T*> ptr;
+
+	public:
+		explicit rcu_ptr(T *initial = nullptr) : ptr(initial) {}
+		~rcu_ptr() { delete ptr.load(); }
+		rcu_ptr(const rcu_ptr&) = delete;
+		rcu_ptr& operator=(const rcu_ptr&) = delete;
+
+		// Only valid while the calling thread holds an rcu_read_guard
+		inline const T * get() const { return ptr.load(std::memory_order_acquire); }
+		inline const T * operator->() const { return get(); }
+
+		void publish(T *next) {
+			T *old = ptr.exchange(next, std::memory_order_seq_cst);
+			if (old != nullptr) {
+				rcu_retire([old]() { delete old; });
+			}
+			rcu_reclaim();
+		}
+};
+#endif
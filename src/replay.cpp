@@ -0,0 +1,239 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include "../autoconf.h"
+#include "radiance.h"
+#include "config.h"
+#include "logger.h"
+#include "database.h"
+#include "site_comm.h"
+#include "worker.h"
+#include "capture.h"
+#include "misc_functions.h"
+#include "user.h"
+#include "domain.h"
+
+/*
+ * Feeds a request capture (see capture_path in radiance.conf) straight into
+ * worker::work, without sockets, and reports throughput, the latency
+ * distribution and how much the database would have been asked to write.
+ *
+ * The database is always readonly. Users, torrents and the blacklist are
+ * loaded from the database in the config file given with -c, or with -s
+ * made up from the passkeys and info hashes seen in the capture itself.
+ *
+ * Usage: radiance-replay [-c config] [-s] [-t] [-x speed] [-n count] capture
+ *   -t  replay at the recorded pace instead of as fast as possible
+ *   -x  speed multiplier for -t (default 1)
+ *   -n  stop after this many requests
+ */
+
+// The tracker globals normally live in radiance.cpp
+struct stats_t stats;
+settings *conf;
+options  *opts;
+
+static void usage(const char *name) {
+	std::cout << "Usage: " << name << " [-c config] [-s] [-t] [-x speed] [-n count] capture" << std::endl;
+}
+
+// Every info_hash parameter of a request line, still percent-encoded
+static std::vector<std::string> info_hashes(const std::string &request) {
+	std::vector<std::string> hashes;
+	size_t end = request.find(' ', 5);
+	size_t pos = request.find('?');
+	while (pos != std::string::npos && pos < end) {
+		if (request.compare(pos + 1, 10, "info_hash=") == 0) {
+			size_t value = pos + 11;
+			size_t next = request.find_first_of("& ", value);
+			hashes.push_back(request.substr(value, next - value));
+		}
+		pos = request.find('&', pos + 1);
+	}
+	return hashes;
+}
+
+// Create a user for every passkey and a torrent for every info hash in the capture
+static void synthesize(const std::string &path, user_list &users, torrent_list &torrents) {
+	capture_reader reader(path);
+	captured_request req;
+	userid_t next_user = 1;
+	torid_t next_torrent = 1;
+	while (reader.next(req)) {
+		if (req.request.length() < 38 || req.request.compare(0, 5, "GET /") != 0 || req.request[37] != '/') {
+			continue;
+		}
+		std::string passkey = req.request.substr(5, 32);
+		if (users.find(passkey) == users.end()) {
+			users.insert(std::pair<std::string, user_ptr>(passkey, user_arena::create(next_user++, true, false, true, 0, 0)));
+		}
+		for (const std::string &hash: info_hashes(req.request)) {
+			std::string info_hash = hex_decode(hash);
+			if (info_hash.length() != 20 || torrents.find(info_hash) != torrents.end()) {
+				continue;
+			}
+			torrent t;
+			t.id = next_torrent++;
+			t.completed = 0;
+			t.paused = 0;
+			t.balance = 0;
+			t.free_torrent = NORMAL;
+			t.double_torrent = NORMAL;
+			t.last_flushed = 0;
+			torrents.insert(std::pair<std::string, torrent>(info_hash, t));
+		}
+	}
+}
+
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(i, sorted.size() - 1)];
+}
+
+int main(int argc, char **argv) {
+	std::string conf_file_path, capture_path;
+	bool synthetic = false, timed = false;
+	double speed = 1.0;
+	uint64_t limit = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") && i < argc - 1) {
+			conf_file_path = argv[++i];
+		} else if (!strcmp(argv[i], "-s")) {
+			synthetic = true;
+		} else if (!strcmp(argv[i], "-t")) {
+			timed = true;
+		} else if (!strcmp(argv[i], "-x") && i < argc - 1) {
+			speed = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-n") && i < argc - 1) {
+			limit = strtoull(argv[++i], NULL, 10);
+		} else if (argv[i][0] != '-' && capture_path.empty()) {
+			capture_path = argv[i];
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (capture_path.empty() || speed <= 0 || (conf_file_path.empty() && !synthetic)) {
+		usage(argv[0]);
+		std::cout << "Either -c or -s is needed to populate users and torrents" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	conf = new settings();
+	opts = new options();
+	if (!conf_file_path.empty()) {
+		std::ifstream conf_file(conf_file_path);
+		if (conf_file.fail()) {
+			std::cerr << "Config file '" << conf_file_path << "' couldn't be opened" << std::endl;
+			return EXIT_FAILURE;
+		}
+		conf->load(conf_file_path, conf_file);
+	}
+	// Never write to the database and don't let per-request logging skew the timings
+	conf->set("tracker", "readonly", "true");
+	conf->set("tracker", "clear_peerlists", "false");
+	conf->set("tracker", "syslog_level", "off");
+	conf->set("tracker", "syslog_path", "off");
+	if (synthetic) {
+		conf->set("tracker", "mysql_db", "");
+	}
+	init_log();
+	{
+		rcu_read_guard guard;
+		huge_page_mode mode;
+		if (parse_huge_page_mode(conf->get()->huge_pages, mode)) {
+			set_huge_page_mode(mode);
+		}
+	}
+
+	capture_reader reader(capture_path);
+	if (!reader.is_valid()) {
+		std::cerr << "'" << capture_path << "' is not a capture file" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	database *db = new database();
+	site_comm *sc = new site_comm();
+	user_list *users = new user_list;
+	torrent_list *torrents = new torrent_list;
+	domain_list *domains = new domain_list;
+	client_blacklist blacklist;
+	if (synthetic) {
+		synthesize(capture_path, *users, *torrents);
+	} else {
+		db->load_site_options();
+		std::vector<user_ptr> removed_users;
+		db->load_users(*users, removed_users);
+		db->load_torrents(*torrents, *domains);
+		db->load_tokens(*torrents);
+		db->load_blacklist(blacklist);
+	}
+	std::cout << users->size() << " users, " << torrents->size() << " torrents" << std::endl;
+	worker *work = new worker(*torrents, *users, *domains, blacklist, db, sc);
+
+	std::vector<uint64_t> latencies; // Nanoseconds
+	uint64_t failures = 0, bytes_out = 0, first_timestamp = 0;
+	captured_request req;
+	auto start = std::chrono::steady_clock::now();
+	while ((limit == 0 || latencies.size() < limit) && reader.next(req)) {
+		if (timed) {
+			if (latencies.empty()) {
+				first_timestamp = req.timestamp;
+			}
+			auto due = start + std::chrono::microseconds(static_cast<uint64_t>((req.timestamp - first_timestamp) / speed));
+			std::this_thread::sleep_until(due);
+		}
+
+		client_opts_t client_opts = {false, false, false, false, false};
+
+		auto request_start = std::chrono::steady_clock::now();
+		std::string response = work->work(req.request, req.client_addr, client_opts);
+		latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - request_start).count());
+
+		bytes_out += response.length();
+		if (response.find("14:failure reason") != std::string::npos) {
+			failures++;
+		}
+		// Readonly flushes just empty the buffers, as the schedule would
+		if (latencies.size() % 10000 == 0) {
+			db->flush();
+		}
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	db->flush();
+
+	uint64_t busy = 0;
+	for (uint64_t l: latencies) {
+		busy += l;
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "requests        " << latencies.size() << " (" << failures << " failures, " << bytes_out << " bytes of responses)" << std::endl;
+	std::cout << "elapsed         " << elapsed << " s" << std::endl;
+	std::cout << "throughput      " << latencies.size() / std::max(elapsed, 1e-9) << " requests/s wall, "
+		<< latencies.size() / std::max(busy / 1e9, 1e-9) << " requests/s in worker::work" << std::endl;
+	std::cout << "latency us      p50 " << percentile(latencies, 0.5) / 1000.0
+		<< "  p90 " << percentile(latencies, 0.9) / 1000.0
+		<< "  p99 " << percentile(latencies, 0.99) / 1000.0
+		<< "  p99.9 " << percentile(latencies, 0.999) / 1000.0
+		<< "  max " << (latencies.empty() ? 0 : latencies.back() / 1000.0) << std::endl;
+	std::cout << "db records" << std::endl;
+	for (auto const &volume: db->get_record_volume()) {
+		std::cout << "  " << std::left << std::setw(14) << volume.first << std::right
+			<< std::setw(12) << volume.second.records << " rows " << std::setw(14) << volume.second.bytes << " bytes" << std::endl;
+	}
+	return 0;
+}
@@ -6,6 +6,8 @@
 #include "response.h"
 #include "user.h"
 #include "domain.h"
+#include "metrics.h"
+#include "tracker_mutex.h"
 
 std::string report(params_type &params, torrent_list &torrents_list, user_list &users_list, domain_list &domains_list, client_opts_t &client_opts) {
 	std::stringstream output;
@@ -53,11 +55,13 @@ std::string report(params_type &params, torrent_list &torrents_list, user_list &
 		<< R"(  "Token queue": )" << stats.token_queue << std::endl
 		<< "}" << std::endl;
 	} else if (action == "domain") {
+		// Live peers per domain they first announced through
 		output << "{" << std::endl;
-		auto domain = domains_list.begin();
-		while (domain != domains_list.end()) {
-			output << R"(  ")" << domain->first << R"(": )" << domain->second.use_count();
-			if (++domain != domains_list.end()) output << ',';
+		domain_id count = domains_list.size();
+		for (domain_id id = 0; id < count; id++) {
+			const domain *d = domains_list.get(id);
+			output << R"(  ")" << d->host << R"(": )" << d->peers.load(std::memory_order_relaxed);
+			if (id + 1 != count) output << ',';
 			output << std::endl;
 		}
 		output << "}" << std::endl;
@@ -122,6 +126,22 @@ std::string report(params_type &params, torrent_list &torrents_list, user_list &
 		<< "    <bytes_written>" << stats.bytes_written << "</bytes_written>" << std::endl
 		<< "  </traffic>" << std::endl
 		<< "</stats>" << std::endl;
+	} else if (action == "locks") {
+		std::vector<lock_stats> locks = get_lock_stats();
+		output << "{" << std::endl;
+		for (auto l = locks.begin(); l != locks.end(); ++l) {
+			output << R"(  ")" << l->name << R"(": { "acquisitions": )" << l->acquisitions
+			<< R"(, "contended": )" << l->contended
+			<< R"(, "failed tries": )" << l->failed_tries
+			<< R"(, "wait us": )" << l->wait_ns / 1000
+			<< R"(, "max hold us": )" << l->max_hold_ns / 1000 << " }";
+			if (l + 1 != locks.end()) output << ',';
+			output << std::endl;
+		}
+		output << "}" << std::endl;
+	} else if (action == "metrics") {
+		client_opts.openmetrics = true;
+		return response(render_metrics(), client_opts, 200);
 	} else {
 		output << "Invalid action" << std::endl;
 	}
@@ -7,7 +7,23 @@
 #include "response.h"
 #include "misc_functions.h"
 
-const std::string response(const std::string &body, client_opts_t &client_opts, uint16_t response) {
+// Digits reserved for the Content-Length a response_writer backfills. HTTP
+// allows whitespace before a header value, so shorter lengths are padded.
+#define LENGTH_FIELD_WIDTH 10
+#define WRITER_INITIAL_SIZE 512
+#define WRITER_MAX_RECYCLE (64 << 10)
+
+std::string gzip_compress(const std::string &data) {
+	std::stringstream ss, zss;
+	ss << data;
+	boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
+	in.push(boost::iostreams::gzip_compressor());
+	in.push(ss);
+	boost::iostreams::copy(in, zss);
+	return zss.str();
+}
+
+std::string response(const std::string &body, client_opts_t &client_opts, uint16_t response) {
 	std::string out;
 	bool processed = false;
 	if (client_opts.html) {
@@ -15,13 +31,7 @@ const std::string response(const std::string &body, client_opts_t &client_opts,
 		processed = true;
 	}
 	if (client_opts.gzip) {
-		std::stringstream ss, zss;
-		ss << body;
-		boost::iostreams::filtering_streambuf<boost::iostreams::input> in;
-		in.push(boost::iostreams::gzip_compressor());
-		in.push(ss);
-		boost::iostreams::copy(in, zss);
-		out = zss.str();
+		out = gzip_compress(body);
 		processed = true;
 	}
 
@@ -46,28 +56,96 @@ const std::string get_reason(uint16_t response) {
 		default:  return "Generic Error";
 	}
 }
-const std::string response_head(size_t content_length, client_opts_t &client_opts, uint16_t response) {
-	std::string content_type = "text/plain";
-	std::string reason = "OK";
+// Everything up to the Content-Length value
+static void write_head(std::string &head, client_opts_t &client_opts, uint16_t response) {
+	const char *content_type = "text/plain";
 	content_type = client_opts.html ? "text/html" : content_type;
 	content_type = client_opts.json ? "application/json" : content_type;
-	if (response == 900) reason = get_reason(response);
-	std::string head = "HTTP/1.1 " + std::to_string(response) + " " + reason +"\r\nServer: Radiance "+PACKAGE_VERSION;
-	head += "\r\nContent-Type: " + content_type;
+	content_type = client_opts.openmetrics ? "application/openmetrics-text; version=1.0.0; charset=utf-8" : content_type;
+	head += "HTTP/1.1 ";
+	append_uint(head, response);
+	head += ' ';
+	if (response == 900) {
+		head += get_reason(response);
+	} else {
+		head += "OK";
+	}
+	head += "\r\nServer: Radiance " PACKAGE_VERSION "\r\nContent-Type: ";
+	head += content_type;
 	if (client_opts.gzip) {
 		head += "\r\nContent-Encoding: gzip";
 	}
 	if (client_opts.http_close) {
 		head += "\r\nConnection: Close";
 	}
-	head += "\r\nContent-Length: " + inttostr(content_length) + "\r\n\r\n";
+	head += "\r\nContent-Length: ";
+}
+
+const std::string response_head(size_t content_length, client_opts_t &client_opts, uint16_t response) {
+	std::string head;
+	head.reserve(160);
+	write_head(head, client_opts, response);
+	append_uint(head, content_length);
+	head += "\r\n\r\n";
 	return head;
 }
 
-const std::string response_error(const std::string &err, client_opts_t &client_opts) {
-	return response("d14:failure reason" + inttostr(err.length()) + ':' + err + "12:min intervali5400e8:intervali5400ee", client_opts, 200);
+std::string response_error(const std::string &err, client_opts_t &client_opts) {
+	response_writer &writer = thread_response_writer();
+	writer.begin(client_opts, 200);
+	writer.raw("d14:failure reason");
+	writer.str(err);
+	writer.raw("12:min intervali5400e8:intervali5400ee");
+	return writer.finish();
 }
 
 const std::string response_warning(const std::string &msg) {
-	return "15:warning message" + inttostr(msg.length()) + ':' + msg;
+	std::string warning = "15:warning message";
+	append_uint(warning, msg.length());
+	warning += ':';
+	warning += msg;
+	return warning;
+}
+
+void response_writer::begin(client_opts_t &opts, uint16_t response) {
+	client_opts = &opts;
+	code = response;
+	buf.clear();
+	if (buf.capacity() < WRITER_INITIAL_SIZE) {
+		buf.reserve(WRITER_INITIAL_SIZE);
+	}
+	write_head(buf, opts, response);
+	length_field = buf.size();
+	buf.append(LENGTH_FIELD_WIDTH, ' ');
+	buf += "\r\n\r\n";
+	body_start = buf.size();
+}
+
+std::string response_writer::finish() {
+	std::string out;
+	size_t content_length = buf.size() - body_start;
+	char digits[INT_BUFFER_SIZE];
+	size_t length = format_uint(digits, content_length) - digits;
+	if (client_opts->gzip || client_opts->html || length > LENGTH_FIELD_WIDTH) {
+		out = response(buf.substr(body_start), *client_opts, code);
+		buf.clear();
+		return out;
+	}
+	memcpy(&buf[length_field + LENGTH_FIELD_WIDTH - length], digits, length);
+	out.swap(buf);
+	return out;
+}
+
+void response_writer::recycle(std::string &buffer) {
+	if (buffer.capacity() > buf.capacity() && buffer.capacity() <= WRITER_MAX_RECYCLE) {
+		buffer.clear();
+		buf.swap(buffer);
+	} else {
+		std::string().swap(buffer);
+	}
+}
+
+response_writer &thread_response_writer() {
+	static thread_local response_writer writer;
+	return writer;
 }
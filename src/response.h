@@ -2,12 +2,62 @@
 #define RESPONSE_H
 
 #include <string>
+#include <cstring>
 #include "radiance.h"
+#include "misc_functions.h"
 
-const std::string response(const std::string &body, client_opts_t &client_opts, uint16_t response);
+std::string response(const std::string &body, client_opts_t &client_opts, uint16_t response);
 const std::string response_head(size_t content_length, client_opts_t &client_opts, uint16_t response);
 const std::string get_reason(uint16_t response);
-const std::string response_error(const std::string &err, client_opts_t &client_opts);
+std::string response_error(const std::string &err, client_opts_t &client_opts);
 const std::string response_warning(const std::string &msg);
+std::string gzip_compress(const std::string &data);
+
+/*
+ * Builds a whole HTTP response in one buffer. begin() writes the header with
+ * a blank Content-Length field, the body is bencoded in place after it and
+ * finish() fills in the length. The buffer is then moved out to the caller,
+ * which should recycle() it once it's been sent so the next response can
+ * reuse the allocation.
+ *
+ * gzip and html responses need the body transformed, finish() falls back to
+ * response() for those.
+ */
+class response_writer {
+	private:
+		std::string buf;
+		size_t length_field; // Offset of the padded Content-Length value
+		size_t body_start;
+		client_opts_t *client_opts;
+		uint16_t code;
+
+	public:
+		response_writer() : length_field(0), body_start(0), client_opts(NULL), code(0) {}
+
+		void begin(client_opts_t &opts, uint16_t response);
+		std::string finish();
+		void recycle(std::string &buffer);
+
+		inline void raw(char c) { buf += c; }
+		inline void raw(const char *data, size_t length) { buf.append(data, length); }
+		inline void raw(const char *data) { raw(data, strlen(data)); }
+
+		inline void str(const char *data, size_t length) {
+			append_uint(buf, length);
+			buf += ':';
+			buf.append(data, length);
+		}
+		inline void str(const char *data) { str(data, strlen(data)); }
+		inline void str(const std::string &data) { str(data.data(), data.size()); }
+
+		inline void integer(int64_t value) {
+			buf += 'i';
+			append_int(buf, value);
+			buf += 'e';
+		}
+};
+
+// Each thread gets its own writer, worker::work and the middleman share the event thread's
+response_writer &thread_response_writer();
 
 #endif
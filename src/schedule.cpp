@@ -8,6 +8,7 @@
 #include "logger.h"
 #include "site_comm.h"
 #include "schedule.h"
+#include "rcu.h"
 
 schedule::schedule(worker * worker_obj, database * db_obj, site_comm * sc_obj) : work(worker_obj), db(db_obj), sc(sc_obj) {
 	load_config();
@@ -15,11 +16,15 @@ schedule::schedule(worker * worker_obj, database * db_obj, site_comm * sc_obj) :
 	last_opened_connections = 0;
 	last_request_count = 0;
 	next_reap_peers = reap_peers_interval;
+	next_full_scrape = 0; // Build the first one right away
 }
 
 void schedule::load_config() {
-	reap_peers_interval = conf->get_uint("reap_peers_interval");
-	schedule_interval = conf->get_uint("schedule_interval");
+	rcu_read_guard guard;
+	const tracker_config *cfg = conf->get();
+	reap_peers_interval = cfg->reap_peers_interval;
+	schedule_interval = cfg->schedule_interval;
+	full_scrape_interval = cfg->full_scrape_interval;
 }
 
 void schedule::reload_config() {
@@ -59,6 +64,7 @@ void schedule::handle(ev::timer &watcher, int events_flags) {
 
 	db->flush();
 	sc->flush_tokens();
+	rcu_reclaim();
 
 	next_reap_peers -= cur_schedule_interval;
 	if (next_reap_peers <= 0) {
@@ -66,6 +72,14 @@ void schedule::handle(ev::timer &watcher, int events_flags) {
 		next_reap_peers = reap_peers_interval;
 	}
 
+	if (full_scrape_interval != 0) {
+		next_full_scrape -= cur_schedule_interval;
+		if (next_full_scrape <= 0) {
+			work->start_full_scrape();
+			next_full_scrape = full_scrape_interval;
+		}
+	}
+
 	counter++;
 	if (schedule_interval != cur_schedule_interval) {
 		watcher.set(schedule_interval, schedule_interval);
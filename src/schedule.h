@@ -11,6 +11,7 @@ class schedule {
 		void load_config();
 
 		unsigned int reap_peers_interval;
+		unsigned int full_scrape_interval;
 		worker * work;
 		database * db;
 		site_comm * sc;
@@ -18,6 +19,7 @@ class schedule {
 		uint64_t last_request_count;
 		unsigned int counter;
 		int next_reap_peers;
+		int next_full_scrape;
 	public:
 		schedule(worker * worker_obj, database * db_obj, site_comm * sc_obj);
 		void reload_config();
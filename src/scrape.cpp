@@ -0,0 +1,170 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+#include "radiance.h"
+#include "scrape.h"
+#include "response.h"
+#include "misc_functions.h"
+#include "logger.h"
+#include "thread_role.h"
+
+// Torrents copied per acquisition of the torrent list lock
+#define FULL_SCRAPE_SLICE 2000
+// Walks restarted because the torrent list was rehashed before the last one keeps the lock
+#define FULL_SCRAPE_MAX_RESTARTS 3
+
+struct scrape_entry {
+	char info_hash[20];
+	uint32_t seeders;
+	uint32_t leechers;
+	uint32_t completed;
+	uint32_t paused;
+};
+
+void append_scrape_entry(std::string &out, const char *info_hash, uint64_t seeders, uint64_t completed, uint64_t leechers, int64_t downloaders) {
+	out += "20:";
+	out.append(info_hash, 20);
+	out += "d8:completei";
+	append_uint(out, seeders);
+	out += "e10:downloadedi";
+	append_uint(out, completed);
+	out += "e10:incompletei";
+	append_uint(out, leechers);
+	out += "e11:downloadersi";
+	append_int(out, downloaders);
+	out += "ee";
+}
+
+full_scrape::full_scrape(torrent_list &torrents_list, tracker_mutex &lock) :
+	torrents(torrents_list), torrents_lock(lock), active(false), stopping(false)
+{
+}
+
+void full_scrape::start() {
+	bool expected = false;
+	if (active.compare_exchange_strong(expected, true)) {
+		// Checked after taking active, so stop() either sees us or we see it
+		if (stopping) {
+			active = false;
+			return;
+		}
+		std::thread thread(&full_scrape::run, this);
+		thread.detach();
+	}
+}
+
+void full_scrape::run() {
+	enter_thread_role(ROLE_FULL_SCRAPE, "full-scrape");
+	regenerate();
+	active = false;
+}
+
+void full_scrape::stop() {
+	stopping = true;
+	while (active) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+void full_scrape::regenerate() {
+	auto start_time = std::chrono::steady_clock::now();
+	std::vector<scrape_entry> entries;
+	size_t bucket = 0, bucket_count = 0;
+	unsigned int restarts = 0;
+	bool locked = false; // Copy the rest without letting go of the lock
+	bool done = false;
+	while (!done) {
+		{
+			std::lock_guard<tracker_mutex> tl_lock(torrents_lock);
+			if (bucket_count == 0) {
+				bucket_count = torrents.bucket_count();
+				entries.reserve(torrents.size());
+			} else if (torrents.bucket_count() != bucket_count) {
+				// Torrents may have moved to buckets that were already walked
+				bucket_count = torrents.bucket_count();
+				entries.clear();
+				bucket = 0;
+				if (++restarts > FULL_SCRAPE_MAX_RESTARTS) {
+					locked = true;
+					stats.full_scrape_locked_walks++;
+					syslog(warning) << "Torrent list rehashed " << FULL_SCRAPE_MAX_RESTARTS
+						<< " times during the full scrape, walking it with the lock held";
+				}
+			}
+			size_t copied = 0;
+			for (; bucket < bucket_count && (locked || copied < FULL_SCRAPE_SLICE); bucket++) {
+				for (auto t = torrents.cbegin(bucket); t != torrents.cend(bucket); ++t) {
+					scrape_entry entry;
+					memcpy(entry.info_hash, t->first.data(), 20);
+					entry.seeders = t->second.seeders.size();
+					entry.leechers = t->second.leechers.size();
+					entry.completed = t->second.completed;
+					entry.paused = t->second.paused;
+					entries.push_back(entry);
+					copied++;
+				}
+			}
+			done = bucket >= bucket_count;
+		}
+		if (stopping) {
+			// Shutting down, the torrent list is about to go away
+			return;
+		}
+		std::this_thread::yield();
+	}
+
+	// Bencoded dictionaries need sorted keys. Sorting also brings together
+	// torrents deleted and added again during the walk, which can be copied twice.
+	std::sort(entries.begin(), entries.end(), [](const scrape_entry &a, const scrape_entry &b) {
+		return memcmp(a.info_hash, b.info_hash, 20) < 0;
+	});
+	entries.erase(std::unique(entries.begin(), entries.end(), [](const scrape_entry &a, const scrape_entry &b) {
+		return memcmp(a.info_hash, b.info_hash, 20) == 0;
+	}), entries.end());
+
+	full_scrape_snapshot *snapshot = new full_scrape_snapshot;
+	std::string &plain = snapshot->plain;
+	plain.reserve(entries.size() * 96 + 16);
+	plain += "d5:filesd";
+	for (const scrape_entry &entry: entries) {
+		append_scrape_entry(plain, entry.info_hash, entry.seeders, entry.completed, entry.leechers, static_cast<int64_t>(entry.leechers) - entry.paused);
+	}
+	plain += "ee";
+	snapshot->gzipped = gzip_compress(plain);
+	snapshot->generated = time(NULL);
+	snapshot->torrents = entries.size();
+	syslog(debug) << "Full scrape of " << entries.size() << " torrents built in "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count() << " ms, "
+		<< plain.size() << " bytes (" << snapshot->gzipped.size() << " gzipped)";
+	current.publish(snapshot);
+}
+
+size_t full_scrape::memory() {
+	rcu_read_guard guard;
+	const full_scrape_snapshot *snapshot = current.get();
+	if (snapshot == nullptr) {
+		return 0;
+	}
+	return snapshot->plain.capacity() + snapshot->gzipped.capacity();
+}
+
+std::string full_scrape::serve(params_type &headers, client_opts_t &client_opts) {
+	rcu_read_guard guard;
+	const full_scrape_snapshot *snapshot = current.get();
+	if (snapshot == nullptr) {
+		return response_error("Full scrape not available", client_opts);
+	}
+	const std::string *body = &snapshot->plain;
+	if (headers["accept-encoding"].find("gzip") != std::string::npos) {
+		client_opts.gzip = true;
+		body = &snapshot->gzipped;
+	}
+	std::string out = response_head(body->size(), client_opts, 200);
+	out.reserve(out.size() + body->size());
+	out += *body;
+	return out;
+}
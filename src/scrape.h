@@ -0,0 +1,52 @@
+#ifndef RADIANCE_SCRAPE_H
+#define RADIANCE_SCRAPE_H
+
+#include <string>
+#include <atomic>
+#include <ctime>
+
+#include "radiance.h"
+#include "rcu.h"
+#include "tracker_mutex.h"
+
+// Appends the bencoded files entry of one torrent, infohash key included
+void append_scrape_entry(std::string &out, const char *info_hash, uint64_t seeders, uint64_t completed, uint64_t leechers, int64_t downloaders);
+
+// What report?get=scrape serves, rebuilt as a whole every full_scrape_interval
+struct full_scrape_snapshot {
+	std::string plain;
+	std::string gzipped;
+	time_t generated;
+	size_t torrents;
+};
+
+/*
+ * Bencoded scrape of every torrent, built by a background thread started
+ * from the schedule. The torrent list is walked bucket by bucket and only
+ * locked for a few thousand torrents at a time, so announces are never held
+ * up for long. A rehash restarts the walk, and if the list keeps growing
+ * under it the final walk holds the lock to the end. Requests are answered from the last published snapshot and
+ * don't look at the torrent list at all.
+ */
+class full_scrape {
+	private:
+		torrent_list &torrents;
+		tracker_mutex &torrents_lock;
+		rcu_ptr<full_scrape_snapshot> current;
+		std::atomic<bool> active;
+		std::atomic<bool> stopping;
+
+		void run();
+
+	public:
+		full_scrape(torrent_list &torrents_list, tracker_mutex &lock);
+		// Regenerate in a background thread unless one is still running
+		void start();
+		// Build and publish a snapshot on this thread, not while start() may be running
+		void regenerate();
+		// Cut a running build short and wait for it, nothing starts after this
+		void stop();
+		std::string serve(params_type &headers, client_opts_t &client_opts);
+		size_t memory(); // Bytes held by the published snapshot
+};
+#endif
@@ -12,6 +12,7 @@
 #include "site_comm.h"
 #include "config.h"
 #include "logger.h"
+#include "thread_role.h"
 
 using boost::asio::ip::tcp;
 
@@ -20,10 +21,12 @@ site_comm::site_comm() : t_active(false) {
 }
 
 void site_comm::load_config() {
-	site_host = conf->get_str("site_host");
-	site_path = conf->get_str("site_path");
-	site_password = conf->get_str("site_password");
-	readonly = conf->get_bool("readonly");
+	rcu_read_guard guard;
+	const tracker_config *cfg = conf->get();
+	site_host = cfg->site_host;
+	site_path = cfg->site_path;
+	site_password = cfg->site_password;
+	readonly = cfg->readonly;
 }
 
 void site_comm::reload_config() {
@@ -75,6 +78,7 @@ void site_comm::flush_tokens()
 
 void site_comm::do_flush_tokens()
 {
+	enter_thread_role(ROLE_SITE_COMM, "site-comm");
 	t_active = true;
 	try {
 		while (!token_queue.empty()) {
@@ -0,0 +1,116 @@
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "../autoconf.h"
+#include "radiance.h"
+#include "thread_role.h"
+#include "config.h"
+#include "logger.h"
+
+#if defined(HAVE_SCHED_SETAFFINITY)
+// Taken by the event loop before pinning itself, every thread after it starts out with its set
+static cpu_set_t process_cpus;
+static bool have_process_cpus = false;
+#endif
+
+bool parse_cpu_list(const std::string &list, std::vector<unsigned int> &cpus) {
+	size_t pos = 0;
+	while (pos < list.size()) {
+		size_t end = list.find(',', pos);
+		if (end == std::string::npos) {
+			end = list.size();
+		}
+		std::string range = list.substr(pos, end - pos);
+		size_t dash = range.find('-');
+		char *rest;
+		unsigned long first = strtoul(range.c_str(), &rest, 10);
+		if (rest == range.c_str() || (dash == std::string::npos && *rest != '\0')) {
+			return false;
+		}
+		unsigned long last = first;
+		if (dash != std::string::npos) {
+			const char *second = range.c_str() + dash + 1;
+			last = strtoul(second, &rest, 10);
+			if (rest == second || *rest != '\0' || last < first) {
+				return false;
+			}
+		}
+		for (unsigned long cpu = first; cpu <= last; cpu++) {
+			cpus.push_back(cpu);
+		}
+		pos = end + 1;
+	}
+	return !cpus.empty();
+}
+
+void enter_thread_role(thread_role role, const std::string &name) {
+#if defined(HAVE_PTHREAD_SETNAME_NP)
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
+
+	std::string cpu_list;
+	unsigned int nice;
+	{
+		rcu_read_guard guard;
+		const tracker_config *cfg = conf->get();
+		switch (role) {
+			case ROLE_EVENT_LOOP:  cpu_list = cfg->event_loop_cpus; break;
+			case ROLE_DB_FLUSH:    cpu_list = cfg->db_flush_cpus; break;
+			case ROLE_REAPER:      cpu_list = cfg->reaper_cpus; break;
+			case ROLE_RELOAD:      cpu_list = cfg->reload_cpus; break;
+			case ROLE_SITE_COMM:   cpu_list = cfg->site_comm_cpus; break;
+			case ROLE_FULL_SCRAPE: cpu_list = cfg->full_scrape_cpus; break;
+		}
+		nice = role == ROLE_EVENT_LOOP ? 0 : cfg->maintenance_nice;
+	}
+
+#if defined(HAVE_SCHED_SETAFFINITY)
+	if (role == ROLE_EVENT_LOOP && !have_process_cpus) {
+		have_process_cpus = sched_getaffinity(0, sizeof(process_cpus), &process_cpus) == 0;
+	}
+	cpu_set_t set;
+	bool pin = false;
+	if (!cpu_list.empty()) {
+		std::vector<unsigned int> cpus;
+		if (parse_cpu_list(cpu_list, cpus)) {
+			CPU_ZERO(&set);
+			for (unsigned int cpu: cpus) {
+				if (cpu < CPU_SETSIZE) {
+					CPU_SET(cpu, &set);
+				}
+			}
+			pin = true;
+		} else {
+			syslog(error) << "Invalid CPU list \"" << cpu_list << "\" for " << name << " threads";
+		}
+	} else if (role != ROLE_EVENT_LOOP && have_process_cpus) {
+		set = process_cpus;
+		pin = true;
+	}
+	// Applies to the calling thread only
+	if (pin && sched_setaffinity(0, sizeof(set), &set) != 0) {
+		syslog(error) << "Could not pin " << name << " to CPUs " << cpu_list << ": " << strerror(errno);
+	}
+#else
+	if (!cpu_list.empty()) {
+		syslog(warning) << "CPU affinity isn't supported here, " << name << " runs on any CPU";
+	}
+#endif
+
+#if defined(__linux__)
+	// Linux keeps nice values per thread, elsewhere this would renice the whole process
+	if (nice != 0 && setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice) != 0) {
+		syslog(warning) << "Could not lower the priority of " << name << ": " << strerror(errno);
+	}
+#endif
+}
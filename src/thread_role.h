@@ -0,0 +1,29 @@
+#ifndef RADIANCE_THREAD_ROLE_H
+#define RADIANCE_THREAD_ROLE_H
+
+#include <string>
+#include <vector>
+
+// What a thread is there for, each role has a CPU set in radiance.conf
+enum thread_role {
+	ROLE_EVENT_LOOP,  // Accepts connections and answers requests
+	ROLE_DB_FLUSH,    // database::do_flush, one thread per queue
+	ROLE_REAPER,
+	ROLE_RELOAD,      // Loading the lists again on SIGUSR1
+	ROLE_SITE_COMM,   // Token expiry requests to the site
+	ROLE_FULL_SCRAPE
+};
+
+/*
+ * Called first thing on a new thread. Names it for top, perf and gdb (Linux
+ * keeps 15 characters), pins it to the role's CPUs and runs everything but
+ * the event loop at nice maintenance_nice. The settings are read on every
+ * call, so threads started after a reload use the new ones.
+ * Roles without CPUs of their own get what the process started with rather
+ * than the event loop's set they'd otherwise inherit.
+ */
+void enter_thread_role(thread_role role, const std::string &name);
+
+// "0-3,8" style lists as taken by taskset, false if malformed
+bool parse_cpu_list(const std::string &list, std::vector<unsigned int> &cpus);
+#endif
@@ -0,0 +1,75 @@
+#include "timing_wheel.h"
+
+timing_wheel::timing_wheel(time_t now) : base(now) {
+	for (unsigned int level = 0; level < WHEEL_LEVELS; level++) {
+		for (unsigned int slot = 0; slot < WHEEL_SLOTS; slot++) {
+			slots[level][slot].prev = slots[level][slot].next = &slots[level][slot];
+		}
+	}
+}
+
+timing_wheel::~timing_wheel() {
+	// Leave the hooks unlinked rather than pointing into a dead wheel
+	for (unsigned int level = 0; level < WHEEL_LEVELS; level++) {
+		for (unsigned int slot = 0; slot < WHEEL_SLOTS; slot++) {
+			wheel_hook &head = slots[level][slot];
+			while (head.next != &head) {
+				head.next->unlink();
+			}
+			head.prev = head.next = nullptr;
+		}
+	}
+}
+
+void timing_wheel::schedule(wheel_hook *hook, time_t deadline) {
+	hook->unlink();
+	hook->deadline = deadline;
+	place(hook);
+}
+
+void timing_wheel::place(wheel_hook *hook) {
+	if (hook->deadline < base) {
+		hook->deadline = base;
+	}
+	uint64_t delta = hook->deadline - base;
+	unsigned int level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >> (WHEEL_BITS * (level + 1)) != 0) {
+		level++;
+	}
+	if (delta >> (WHEEL_BITS * WHEEL_LEVELS) != 0) {
+		hook->deadline = base + (1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+	}
+	wheel_hook &head = slots[level][(hook->deadline >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	hook->next = &head;
+	hook->prev = head.prev;
+	head.prev->next = hook;
+	head.prev = hook;
+}
+
+// Spread the current slot of a level over the levels below, returns its index
+unsigned int timing_wheel::cascade(unsigned int level) {
+	unsigned int index = (base >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	wheel_hook pending;
+	pending.prev = pending.next = &pending;
+	splice(slots[level][index], pending);
+	while (pending.next != &pending) {
+		wheel_hook *hook = pending.next;
+		hook->unlink();
+		place(hook);
+	}
+	pending.prev = pending.next = nullptr;
+	return index;
+}
+
+// Move every hook of one list to the front of another
+void timing_wheel::splice(wheel_hook &from, wheel_hook &to) {
+	if (from.next == &from) {
+		return;
+	}
+	wheel_hook *first = from.next, *last = from.prev;
+	last->next = to.next;
+	to.next->prev = last;
+	to.next = first;
+	first->prev = &to;
+	from.prev = from.next = &from;
+}
@@ -0,0 +1,100 @@
+#ifndef RADIANCE_TIMING_WHEEL_H
+#define RADIANCE_TIMING_WHEEL_H
+
+#include <ctime>
+#include <stdint.h>
+
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4 // Deadlines up to 2^24 seconds (194 days) ahead
+
+/*
+ * Intrusive link into a timing_wheel, embedded in whatever expires. A hook
+ * unlinks itself when destroyed, so erasing its owner from a container is
+ * all it takes to cancel it. Copies start out unlinked.
+ */
+class wheel_hook {
+	friend class timing_wheel;
+	private:
+		wheel_hook *prev;
+		wheel_hook *next;
+		time_t deadline;
+
+	public:
+		wheel_hook() : prev(nullptr), next(nullptr), deadline(0) {}
+		wheel_hook(const wheel_hook&) : prev(nullptr), next(nullptr), deadline(0) {}
+		wheel_hook& operator=(const wheel_hook&) { return *this; }
+		~wheel_hook() { unlink(); }
+
+		inline bool linked() const { return next != nullptr; }
+		inline void unlink() {
+			if (next != nullptr) {
+				prev->next = next;
+				next->prev = prev;
+				prev = next = nullptr;
+			}
+		}
+};
+
+/*
+ * Hierarchical timing wheel with one second resolution. Scheduling and
+ * cancelling are O(1) and advancing only touches the hooks that are due,
+ * plus one cascade of a higher level slot every 64 seconds.
+ *
+ * Not thread safe, the owner serialises access.
+ */
+class timing_wheel {
+	private:
+		wheel_hook slots[WHEEL_LEVELS][WHEEL_SLOTS]; // Circular lists with the slot as head
+		time_t base; // Next second to process
+
+		void place(wheel_hook *hook);
+		unsigned int cascade(unsigned int level);
+		static void splice(wheel_hook &from, wheel_hook &to);
+
+	public:
+		explicit timing_wheel(time_t now);
+		~timing_wheel();
+		timing_wheel(const timing_wheel&) = delete;
+		timing_wheel& operator=(const timing_wheel&) = delete;
+
+		// Fire hook at deadline, moving it if it's already scheduled
+		void schedule(wheel_hook *hook, time_t deadline);
+
+		// Hand every hook due at or before now to expire, unlinked. expire
+		// may destroy the hook or schedule it again, and returns false to
+		// stop early. Returns true once nothing due is left, otherwise the
+		// next call carries on where this one stopped.
+		template <typename F> bool advance(time_t now, F expire) {
+			while (base <= now) {
+				// Cascading again after stopping early is harmless, place() only
+				// ever looks at the distance to base
+				if ((base & WHEEL_MASK) == 0) {
+					for (unsigned int level = 1; level < WHEEL_LEVELS && cascade(level) == 0; level++);
+				}
+				wheel_hook &slot = slots[0][base & WHEEL_MASK];
+				wheel_hook due;
+				due.prev = due.next = &due;
+				splice(slot, due);
+				bool more = true;
+				while (more && due.next != &due) {
+					wheel_hook *hook = due.next;
+					hook->unlink();
+					more = expire(hook);
+				}
+				bool unfinished = due.next != &due;
+				splice(due, slot);
+				due.prev = due.next = nullptr;
+				if (unfinished) {
+					return false;
+				}
+				base++;
+				if (!more) {
+					return base > now;
+				}
+			}
+			return true;
+		}
+};
+#endif
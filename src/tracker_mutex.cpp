@@ -0,0 +1,95 @@
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "tracker_mutex.h"
+
+#if defined(ENABLE_LOCK_STATS)
+// Every instrumented lock registers itself so the report can enumerate them
+static std::vector<tracker_mutex*> &registry() {
+	static std::vector<tracker_mutex*> list;
+	return list;
+}
+static std::mutex &registry_lock() {
+	static std::mutex lock;
+	return lock;
+}
+
+tracker_mutex::tracker_mutex(const char *name) : name(name), acquisitions(0), contended(0), failed_tries(0), wait_ns(0), max_hold_ns(0) {
+	std::lock_guard<std::mutex> lock(registry_lock());
+	registry().push_back(this);
+}
+
+tracker_mutex::~tracker_mutex() {
+	std::lock_guard<std::mutex> lock(registry_lock());
+	auto &list = registry();
+	list.erase(std::remove(list.begin(), list.end(), this), list.end());
+}
+
+void tracker_mutex::lock() {
+	if (mutex.try_lock()) {
+		acquired(false, std::chrono::steady_clock::time_point());
+		return;
+	}
+	auto start = std::chrono::steady_clock::now();
+	mutex.lock();
+	acquired(true, start);
+}
+
+bool tracker_mutex::try_lock() {
+	if (!mutex.try_lock()) {
+		failed_tries.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	acquired(false, std::chrono::steady_clock::time_point());
+	return true;
+}
+
+void tracker_mutex::unlock() {
+	released();
+	mutex.unlock();
+}
+
+void tracker_mutex::acquired(bool waited, std::chrono::steady_clock::time_point start) {
+	locked_at = std::chrono::steady_clock::now();
+	acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (waited) {
+		contended.fetch_add(1, std::memory_order_relaxed);
+		wait_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(locked_at - start).count(), std::memory_order_relaxed);
+	}
+}
+
+void tracker_mutex::released() {
+	uint64_t held = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - locked_at).count();
+	uint64_t max_held = max_hold_ns.load(std::memory_order_relaxed);
+	while (held > max_held && !max_hold_ns.compare_exchange_weak(max_held, held, std::memory_order_relaxed)) {}
+}
+
+lock_stats tracker_mutex::get_stats() const {
+	lock_stats s;
+	s.name         = name;
+	s.acquisitions = acquisitions.load(std::memory_order_relaxed);
+	s.contended    = contended.load(std::memory_order_relaxed);
+	s.failed_tries = failed_tries.load(std::memory_order_relaxed);
+	s.wait_ns      = wait_ns.load(std::memory_order_relaxed);
+	s.max_hold_ns  = max_hold_ns.load(std::memory_order_relaxed);
+	return s;
+}
+
+std::vector<lock_stats> get_lock_stats() {
+	std::vector<lock_stats> all;
+	std::lock_guard<std::mutex> lock(registry_lock());
+	for (const tracker_mutex *m: registry()) {
+		all.push_back(m->get_stats());
+	}
+	return all;
+}
+#else
+tracker_mutex::tracker_mutex(const char *name) : name(name) {}
+
+tracker_mutex::~tracker_mutex() {}
+
+std::vector<lock_stats> get_lock_stats() {
+	return std::vector<lock_stats>();
+}
+#endif
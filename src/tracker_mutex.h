@@ -0,0 +1,65 @@
+#ifndef RADIANCE_TRACKER_MUTEX_H
+#define RADIANCE_TRACKER_MUTEX_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <stdint.h>
+
+#include "../autoconf.h"
+
+// Contention counters for one named lock, see get_lock_stats()
+struct lock_stats {
+	const char *name;
+	uint64_t acquisitions;
+	uint64_t contended;    // Acquisitions that had to wait
+	uint64_t failed_tries; // try_lock() calls that found it held, not acquisitions
+	uint64_t wait_ns;
+	uint64_t max_hold_ns;
+};
+
+/*
+ * Drop-in replacement for std::mutex that carries a name. When configured
+ * with --enable-lock-stats it also records how often the lock is taken, how
+ * often a thread had to wait for it, the total wait time and the longest
+ * time it was held. Failed try_lock() calls are counted on their own. Otherwise it compiles down to a plain std::mutex.
+ */
+class tracker_mutex {
+	private:
+		std::mutex mutex;
+		const char *name;
+#if defined(ENABLE_LOCK_STATS)
+		std::atomic<uint64_t> acquisitions;
+		std::atomic<uint64_t> contended;
+		std::atomic<uint64_t> failed_tries;
+		std::atomic<uint64_t> wait_ns;
+		std::atomic<uint64_t> max_hold_ns;
+		std::chrono::steady_clock::time_point locked_at; // Only touched by the owner
+		void acquired(bool waited, std::chrono::steady_clock::time_point start);
+		void released();
+#endif
+
+	public:
+		explicit tracker_mutex(const char *name);
+		~tracker_mutex();
+		tracker_mutex(const tracker_mutex&) = delete;
+		tracker_mutex& operator=(const tracker_mutex&) = delete;
+
+#if defined(ENABLE_LOCK_STATS)
+		void lock();
+		bool try_lock();
+		void unlock();
+		lock_stats get_stats() const;
+#else
+		inline void lock() { mutex.lock(); }
+		inline bool try_lock() { return mutex.try_lock(); }
+		inline void unlock() { mutex.unlock(); }
+#endif
+		const inline char * get_name() const { return name; }
+};
+
+// Counters for every live tracker_mutex, empty unless built with lock stats
+std::vector<lock_stats> get_lock_stats();
+
+#endif
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <random>
+#include <cstring>
+
+#include "unregistered.h"
+
+#define FILTER_BITS_PER_HASH 16
+#define FILTER_MIN_CAPACITY  1024
+#define FILTER_PROBES        7 // 9 bits each out of the second hash
+#define TOMBSTONE_RECENT_MAX 256
+
+static inline uint64_t load64(const char *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Info hashes are client supplied, so mix them with a per-process seed
+static inline uint64_t mix(uint64_t x) {
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+infohash_filter::infohash_filter() : current(nullptr), removed(0) {
+	std::random_device rd;
+	seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+}
+
+void infohash_filter::set(bitset &bits, const char *info_hash) {
+	uint64_t h1 = mix(load64(info_hash) ^ seed);
+	uint64_t h2 = mix(load64(info_hash + 8) ^ seed);
+	std::atomic<uint64_t> *block = &bits.words[(h1 & bits.block_mask) * 8];
+	for (unsigned int i = 0; i < FILTER_PROBES; i++, h2 >>= 9) {
+		block[h2 & 7].fetch_or(1ULL << ((h2 >> 3) & 63), std::memory_order_relaxed);
+	}
+	bits.entries++;
+}
+
+size_t infohash_filter::memory() const {
+	rcu_read_guard guard;
+	const bitset *bits = current.get();
+	return bits == nullptr ? 0 : (bits->block_mask + 1) * 8 * sizeof(uint64_t);
+}
+
+bool infohash_filter::may_contain(const std::string &info_hash) const {
+	const bitset *bits = current.get();
+	if (bits == nullptr || info_hash.size() != 20) {
+		return true;
+	}
+	uint64_t h1 = mix(load64(info_hash.data()) ^ seed);
+	uint64_t h2 = mix(load64(info_hash.data() + 8) ^ seed);
+	const std::atomic<uint64_t> *block = &bits->words[(h1 & bits->block_mask) * 8];
+	for (unsigned int i = 0; i < FILTER_PROBES; i++, h2 >>= 9) {
+		if ((block[h2 & 7].load(std::memory_order_relaxed) & (1ULL << ((h2 >> 3) & 63))) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void infohash_filter::add(const std::string &info_hash, const torrent_list &torrents) {
+	if (info_hash.size() != 20) {
+		return; // set() reads 16 bytes, rebuild() leaves these out too
+	}
+	// Only the writer changes the published bitset, no guard needed to look at it
+	bitset *bits = const_cast<bitset*>(current.get());
+	if (bits == nullptr || bits->entries >= bits->capacity) {
+		rebuild(torrents);
+	} else {
+		set(*bits, info_hash.data());
+	}
+}
+
+void infohash_filter::remove(const torrent_list &torrents) {
+	const bitset *bits = current.get();
+	if (bits != nullptr && ++removed * 4 > bits->entries) {
+		rebuild(torrents);
+	}
+}
+
+void infohash_filter::rebuild(const torrent_list &torrents) {
+	bitset *bits = new bitset;
+	bits->capacity = std::max(torrents.size() * 2, (size_t)FILTER_MIN_CAPACITY);
+	size_t blocks = 1;
+	while (blocks * 512 < bits->capacity * FILTER_BITS_PER_HASH) {
+		blocks <<= 1;
+	}
+	bits->block_mask = blocks - 1;
+	bits->entries = 0;
+	bits->words.reset(new std::atomic<uint64_t>[blocks * 8]);
+	for (size_t i = 0; i < blocks * 8; i++) {
+		bits->words[i].store(0, std::memory_order_relaxed);
+	}
+	for (auto const &t: torrents) {
+		if (t.first.size() == 20) {
+			set(*bits, t.first.data());
+		}
+	}
+	removed = 0;
+	current.publish(bits);
+}
+
+static bool tombstone_less(const tombstone &a, const tombstone &b) {
+	return memcmp(a.info_hash, b.info_hash, 20) < 0;
+}
+
+static const tombstone * search(const std::vector<tombstone> &list, const tombstone &key) {
+	auto it = std::lower_bound(list.begin(), list.end(), key, tombstone_less);
+	if (it != list.end() && memcmp(it->info_hash, key.info_hash, 20) == 0) {
+		return &*it;
+	}
+	return nullptr;
+}
+
+tombstone_index::tombstone_index() {
+	snapshot *empty = new snapshot;
+	empty->bulk = std::make_shared<const std::vector<tombstone>>();
+	current.publish(empty);
+}
+
+const tombstone * tombstone_index::find(const std::string &info_hash) const {
+	if (info_hash.size() != 20) {
+		return nullptr;
+	}
+	tombstone key;
+	memcpy(key.info_hash, info_hash.data(), 20);
+	const snapshot *snap = current.get();
+	// Recent ones first, a torrent can be deleted again after being re-added
+	const tombstone *found = search(snap->recent, key);
+	return found != nullptr ? found : search(*snap->bulk, key);
+}
+
+void tombstone_index::add(const std::string &info_hash, int reason, time_t time) {
+	if (info_hash.size() != 20) {
+		return;
+	}
+	tombstone entry;
+	memcpy(entry.info_hash, info_hash.data(), 20);
+	entry.reason = reason;
+	entry.time = time;
+
+	std::lock_guard<std::mutex> lock(write_lock);
+	rcu_read_guard guard;
+	const snapshot *old = current.get();
+	snapshot *next = new snapshot;
+	next->recent = old->recent;
+	auto it = std::lower_bound(next->recent.begin(), next->recent.end(), entry, tombstone_less);
+	if (it != next->recent.end() && memcmp(it->info_hash, entry.info_hash, 20) == 0) {
+		*it = entry;
+	} else {
+		next->recent.insert(it, entry);
+	}
+	if (next->recent.size() < TOMBSTONE_RECENT_MAX) {
+		next->bulk = old->bulk;
+	} else {
+		// Merge, recent entries replace older ones for the same hash
+		std::vector<tombstone> *merged = new std::vector<tombstone>;
+		merged->reserve(old->bulk->size() + next->recent.size());
+		auto b = old->bulk->cbegin();
+		auto r = next->recent.cbegin();
+		while (b != old->bulk->cend() || r != next->recent.cend()) {
+			if (r == next->recent.cend() || (b != old->bulk->cend() && tombstone_less(*b, *r))) {
+				merged->push_back(*b++);
+			} else {
+				if (b != old->bulk->cend() && !tombstone_less(*r, *b)) {
+					++b;
+				}
+				merged->push_back(*r++);
+			}
+		}
+		next->bulk.reset(merged);
+		next->recent.clear();
+	}
+	current.publish(next);
+}
+
+size_t tombstone_index::expire(time_t max_time) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	rcu_read_guard guard;
+	const snapshot *old = current.get();
+	auto expired = [max_time](const tombstone &t) { return t.time <= max_time; };
+	size_t count = std::count_if(old->bulk->begin(), old->bulk->end(), expired)
+		+ std::count_if(old->recent.begin(), old->recent.end(), expired);
+	if (count == 0) {
+		return 0;
+	}
+	snapshot *next = new snapshot;
+	std::vector<tombstone> *bulk = new std::vector<tombstone>;
+	std::remove_copy_if(old->bulk->begin(), old->bulk->end(), std::back_inserter(*bulk), expired);
+	next->bulk.reset(bulk);
+	std::remove_copy_if(old->recent.begin(), old->recent.end(), std::back_inserter(next->recent), expired);
+	current.publish(next);
+	return count;
+}
+
+size_t tombstone_index::size() const {
+	rcu_read_guard guard;
+	const snapshot *snap = current.get();
+	return snap->bulk->size() + snap->recent.size();
+}
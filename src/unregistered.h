@@ -0,0 +1,80 @@
+#ifndef RADIANCE_UNREGISTERED_H
+#define RADIANCE_UNREGISTERED_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <ctime>
+#include <stdint.h>
+
+#include "radiance.h"
+#include "rcu.h"
+
+/*
+ * Blocked Bloom filter over the info hashes in the torrent list, so
+ * announces for torrents that don't exist can be turned away without
+ * taking torrent_list_mutex. A hash that was added is always found, a
+ * missing one is found by mistake about once in a thousand lookups and
+ * then takes the normal path.
+ *
+ * Lookups are lock free and need an rcu_read_guard. Everything else is
+ * called with the torrent list locked. Bloom filters can't forget, so
+ * removals are only counted and the filter is rebuilt from the torrent
+ * list once enough of it is stale, or once it's full.
+ */
+class infohash_filter {
+	private:
+		struct bitset {
+			size_t block_mask; // Number of 512 bit blocks - 1
+			size_t capacity;   // Hashes it was sized for
+			size_t entries;
+			std::unique_ptr<std::atomic<uint64_t>[]> words;
+		};
+		rcu_ptr<bitset> current;
+		size_t removed; // Since the last rebuild
+		uint64_t seed;
+
+		void set(bitset &bits, const char *info_hash);
+
+	public:
+		infohash_filter();
+		bool may_contain(const std::string &info_hash) const;
+		void add(const std::string &info_hash, const torrent_list &torrents);
+		void remove(const torrent_list &torrents);
+		void rebuild(const torrent_list &torrents);
+		size_t memory() const; // Bytes of the current bit array
+};
+
+// Why a torrent is gone, kept for del_reason_lifetime after it was deleted
+struct tombstone {
+	char info_hash[20];
+	int reason;
+	time_t time;
+};
+
+/*
+ * Delete reasons by info hash, in two sorted arrays: the bulk, and recent
+ * deletions that get merged into it once there are enough of them. Both are
+ * published through RCU, so lookups are lock free binary searches and need
+ * an rcu_read_guard. Adding only copies the small array.
+ */
+class tombstone_index {
+	private:
+		struct snapshot {
+			std::shared_ptr<const std::vector<tombstone>> bulk;
+			std::vector<tombstone> recent;
+		};
+		rcu_ptr<snapshot> current;
+		std::mutex write_lock;
+
+	public:
+		tombstone_index();
+		const tombstone * find(const std::string &info_hash) const;
+		void add(const std::string &info_hash, int reason, time_t time);
+		// Forget everything deleted at or before max_time, returns how many
+		size_t expire(time_t max_time);
+		size_t size() const;
+};
+#endif
@@ -1,6 +1,158 @@
+#include <new>
+#include <cmath>
+#include <vector>
+
 #include "user.h"
+#include "pool.h"
+#include "memory.h"
 
 user::user(userid_t uid, bool leech, bool protect, bool track_ipv6, time_t pfl, time_t pds) : id(uid), deleted(false), leechstatus(leech), protect_ip(protect), ipv6(track_ipv6), personalfreeleech(pfl), personaldoubleseed(pds) {
 	stats.leeching = 0;
 	stats.seeding = 0;
 }
+
+std::atomic<user_arena::slot*> user_arena::chunks[USER_ARENA_CHUNKS];
+
+// Slot allocation only, lookups never lock
+static std::mutex &arena_lock() {
+	static std::mutex lock;
+	return lock;
+}
+static std::vector<uint32_t> &free_slots() {
+	static std::vector<uint32_t> list;
+	return list;
+}
+static uint32_t next_slot = 0;
+static size_t live_users = 0;
+
+user_ptr user_arena::create(userid_t uid, bool leech, bool protect, bool track_ipv6, time_t pfl, time_t pds) {
+	uint32_t index;
+	slot *chunk;
+	{
+		std::lock_guard<std::mutex> lock(arena_lock());
+		if (!free_slots().empty()) {
+			index = free_slots().back();
+			free_slots().pop_back();
+			chunk = chunks[index >> USER_ARENA_CHUNK_BITS].load(std::memory_order_relaxed);
+		} else {
+			index = next_slot;
+			if ((index >> USER_ARENA_CHUNK_BITS) >= USER_ARENA_CHUNKS) {
+				throw std::bad_alloc();
+			}
+			chunk = chunks[index >> USER_ARENA_CHUNK_BITS].load(std::memory_order_relaxed);
+			if (chunk == nullptr) {
+				// Next to the peers and torrents, so it gets huge pages when they do
+				chunk = static_cast<slot*>(region_alloc(USER_ARENA_CHUNK_SIZE * sizeof(slot)));
+				for (size_t i = 0; i < USER_ARENA_CHUNK_SIZE; i++) {
+					new (&chunk[i]) slot;
+					chunk[i].generation.store(1, std::memory_order_relaxed);
+				}
+				chunks[index >> USER_ARENA_CHUNK_BITS].store(chunk, std::memory_order_release);
+			}
+			next_slot++;
+		}
+		live_users++;
+	}
+	slot &s = chunk[index & (USER_ARENA_CHUNK_SIZE - 1)];
+	user_ptr u = new (&s.storage) user(uid, leech, protect, track_ipv6, pfl, pds);
+	u->self = user_ref(index, s.generation.load(std::memory_order_relaxed));
+	return u;
+}
+
+void user_arena::release(user_ptr u) {
+	user_ref ref = u->self;
+	slot &s = chunks[ref.index >> USER_ARENA_CHUNK_BITS].load(std::memory_order_relaxed)[ref.index & (USER_ARENA_CHUNK_SIZE - 1)];
+	uint32_t next = ref.generation + 1;
+	s.generation.store(next == 0 ? 1 : next, std::memory_order_release);
+	rcu_retire([u, ref]() {
+		u->~user();
+		std::lock_guard<std::mutex> lock(arena_lock());
+		free_slots().push_back(ref.index);
+		live_users--;
+	});
+}
+
+size_t user_arena::size() {
+	std::lock_guard<std::mutex> lock(arena_lock());
+	return live_users;
+}
+
+size_t user_arena::memory() {
+	std::lock_guard<std::mutex> lock(arena_lock());
+	size_t allocated = (next_slot + USER_ARENA_CHUNK_SIZE - 1) >> USER_ARENA_CHUNK_BITS;
+	return allocated * USER_ARENA_CHUNK_SIZE * sizeof(slot);
+}
+
+// Fold the recent changes into a new bulk copy once there are this many
+// plus the square root of the bulk size of them
+#define PASSKEY_RECENT_MIN 64
+
+passkey_table::passkey_table() {
+	snapshot *empty = new snapshot;
+	empty->bulk = std::make_shared<const user_list>();
+	current.publish(empty);
+}
+
+const user_ptr * passkey_table::find(const std::string &passkey) const {
+	const snapshot *snap = current.get();
+	if (!snap->recent.empty()) {
+		auto r = snap->recent.find(passkey);
+		if (r != snap->recent.end()) {
+			return r->second ? &r->second : nullptr;
+		}
+	}
+	auto b = snap->bulk->find(passkey);
+	return b != snap->bulk->end() ? &b->second : nullptr;
+}
+
+void passkey_table::update(const changes &changed) {
+	if (changed.empty()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(write_lock);
+	// Only writers publish and they hold write_lock, so old stays put
+	const snapshot *old = current.get();
+	snapshot *next = new snapshot;
+	next->recent = old->recent;
+	for (auto const &change: changed) {
+		next->recent[change.first] = change.second;
+	}
+	if (next->recent.size() < PASSKEY_RECENT_MIN + static_cast<size_t>(std::sqrt(old->bulk->size()))) {
+		next->bulk = old->bulk;
+	} else {
+		user_list *merged = new user_list(*old->bulk);
+		for (auto const &change: next->recent) {
+			if (change.second) {
+				(*merged)[change.first] = change.second;
+			} else {
+				merged->erase(change.first);
+			}
+		}
+		next->bulk.reset(merged);
+		next->recent.clear();
+	}
+	current.publish(next);
+}
+
+void passkey_table::set(const std::string &passkey, const user_ptr &u) {
+	update(changes{{passkey, u}});
+}
+
+void passkey_table::erase(const std::string &passkey) {
+	update(changes{{passkey, nullptr}});
+}
+
+void passkey_table::rebuild(const user_list &users) {
+	std::lock_guard<std::mutex> lock(write_lock);
+	snapshot *next = new snapshot;
+	next->bulk = std::make_shared<const user_list>(users);
+	current.publish(next);
+}
+
+memory_usage passkey_table::memory() const {
+	rcu_read_guard guard;
+	const snapshot *snap = current.get();
+	uint64_t entries = snap->bulk->size() + snap->recent.size();
+	return {"passkey table", entries, bucket_bytes(*snap->bulk) + bucket_bytes(snap->recent),
+		entries * malloc_size(hash_node_size<user_list>()), entries * string_heap(32)};
+}
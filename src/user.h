@@ -2,10 +2,20 @@
 #define USER_H
 
 #include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <type_traits>
 #include "radiance.h"
+#include "rcu.h"
+
+struct memory_usage;
 
 class user {
+	friend class user_arena;
 	private:
+		user_ref self;
 		userid_t id;
 		bool deleted;
 		bool leechstatus;
@@ -19,6 +29,7 @@ class user {
 		} stats;
 	public:
 		user(userid_t uid, bool leech, bool protect, bool track_ipv6, time_t pfl, time_t pds);
+		const inline user_ref ref() { return self; }
 		const inline userid_t get_id() { return id; }
 		const inline bool is_deleted() { return deleted; }
 		void inline set_deleted(bool status) { deleted = status; }
@@ -40,4 +51,81 @@ class user {
 		void inline set_personalfreeleech(time_t pfl) { personalfreeleech = pfl; }
 		void inline set_personaldoubleseed(time_t pds) { personaldoubleseed = pds; }
 };
+
+#define USER_ARENA_CHUNK_BITS 12
+#define USER_ARENA_CHUNK_SIZE (1 << USER_ARENA_CHUNK_BITS)
+#define USER_ARENA_CHUNKS     (1 << 14) // Room for 64M users
+
+/*
+ * Every user lives in a slot of this arena, allocated in chunks that never
+ * move, and peers refer to it by slot index and generation instead of
+ * holding a reference count.
+ *
+ * Releasing a user bumps the slot's generation right away, so peers of a
+ * removed user resolve to nullptr. The user itself is destroyed and the
+ * slot reused after an RCU grace period, which keeps pointers handed out by
+ * passkey_table valid for readers still holding a guard. Anything that
+ * resolves a user_ref off the worker thread needs a guard too.
+ */
+class user_arena {
+	private:
+		struct slot {
+			std::atomic<uint32_t> generation;
+			typename std::aligned_storage<sizeof(user), alignof(user)>::type storage;
+		};
+		static std::atomic<slot*> chunks[USER_ARENA_CHUNKS];
+
+	public:
+		static user_ptr create(userid_t uid, bool leech, bool protect, bool track_ipv6, time_t pfl, time_t pds);
+		// Call once the user can't be found in users_list or a passkey_table any more
+		static void release(user_ptr u);
+		static size_t size();
+		static size_t memory(); // Bytes in the chunks allocated so far
+
+		static inline user_ptr get(user_ref ref) {
+			slot *chunk = chunks[ref.index >> USER_ARENA_CHUNK_BITS].load(std::memory_order_acquire);
+			if (chunk == nullptr) {
+				return nullptr;
+			}
+			slot &s = chunk[ref.index & (USER_ARENA_CHUNK_SIZE - 1)];
+			if (s.generation.load(std::memory_order_acquire) != ref.generation) {
+				return nullptr;
+			}
+			return reinterpret_cast<user*>(&s.storage);
+		}
+};
+
+/*
+ * Read side of the user list. users_list stays the authoritative copy and
+ * is only changed with user_list_mutex held, every change is then mirrored
+ * here. Lookups take no lock and copy no user_ptr: the returned pointer
+ * stays valid until the caller leaves its rcu_read_guard.
+ *
+ * Snapshots share one bulk copy of the list and carry the passkeys changed
+ * since it was made. Every update copies those changes into the next
+ * snapshot, and once there are more than about the square root of the user
+ * count they are folded into a new bulk copy. Either way an update costs
+ * about 2 * sqrt(users) node copies on average, with the user list locked:
+ * around 2000 for a million users. Bulk changes should go through rebuild().
+ */
+class passkey_table {
+	private:
+		struct snapshot {
+			std::shared_ptr<const user_list> bulk;
+			user_list recent; // nullptr for removed passkeys
+		};
+		rcu_ptr<snapshot> current;
+		std::mutex write_lock;
+
+	public:
+		typedef std::vector<std::pair<std::string, user_ptr>> changes;
+
+		passkey_table();
+		const user_ptr * find(const std::string &passkey) const;
+		void update(const changes &changed);
+		void set(const std::string &passkey, const user_ptr &u);
+		void erase(const std::string &passkey);
+		void rebuild(const user_list &users);
+		memory_usage memory() const; // The bulk copy and the recent changes
+};
 #endif
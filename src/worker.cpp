@@ -1,7 +1,6 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
-#include <netdb.h>
 #include <iostream>
 #include <string>
 #include <map>
@@ -25,37 +24,46 @@
 #include "user.h"
 #include "domain.h"
 #include "logger.h"
+#include "rcu.h"
+#include "ip_address.h"
+#include "percent_decode.h"
+#include "metrics.h"
+#include "pool.h"
+#include "events.h"
+#include "thread_role.h"
 
 //---------- Worker - does stuff with input
-worker::worker(torrent_list &torrents, user_list &users, domain_list &domains, std::vector<std::string> &_blacklist, database * db_obj, site_comm * sc) :
-	db(db_obj), s_comm(sc), torrents_list(torrents), users_list(users), domains_list(domains), blacklist(_blacklist), status(OPEN), reaper_active(false)
+worker::worker(torrent_list &torrents, user_list &users, domain_list &domains, client_blacklist &_blacklist, database * db_obj, site_comm * sc) :
+	db(db_obj), s_comm(sc), torrents_list(torrents), users_list(users), domains_list(domains), blacklist(_blacklist), status(OPEN), reaper_active(false),
+	full_scrape_cache(torrents, db_obj->torrent_list_mutex), peer_expiry(time(NULL)), token_expiry(time(NULL))
 {
-	load_config();
-}
-
-void worker::load_config() {
-	announce_interval = conf->get_uint("announce_interval");
-	del_reason_lifetime = conf->get_uint("del_reason_lifetime");
-	peers_timeout = conf->get_uint("peers_timeout");
-	numwant_limit = conf->get_uint("numwant_limit");
-	keepalive_enabled = conf->get_uint("keepalive_timeout") != 0;
-	real_ip_header = conf->get_str("real_ip_header");
-	std::transform(real_ip_header.begin(), real_ip_header.end(), real_ip_header.begin(), ::tolower);
-	site_password = conf->get_str("site_password");
-	report_password = conf->get_str("report_password");
-	anonymous = conf->get_bool("anonymous");
-	anonymous_password = conf->get_str("anonymous_password");
-}
-
-void worker::reload_config() {
-	load_config();
+	track_loaded();
+	rebuild_torrent_filter();
+	rebuild_passkey_table();
+
+	// Most unregistered torrent announces are answered with one of these
+	for (int http_close = 0; http_close < 2; http_close++) {
+		for (int reason = -1; reason <= AUDIENCE + 1; reason++) {
+			client_opts_t client_opts = {false, false, false, false, http_close == 1};
+			std::string message = "Unregistered torrent";
+			if (reason != -1) {
+				message += ": " + get_del_reason(reason);
+			}
+			unregistered_responses[http_close][reason + 1] = response_error(message, client_opts);
+		}
+	}
 }
 
 void worker::reload_lists() {
 	status = PAUSED;
 	db->load_site_options();
-	db->load_users(users_list);
-	db->load_torrents(torrents_list);
+	std::vector<user_ptr> removed_users;
+	db->load_users(users_list, removed_users);
+	rebuild_passkey_table();
+	for (user_ptr removed_user: removed_users) {
+		user_arena::release(removed_user);
+	}
+	db->load_torrents(torrents_list, domains_list);
 	for (auto const &user: users_list) {
 		// Reset user stats
 		user.second->reset_stats();
@@ -63,6 +71,8 @@ void worker::reload_lists() {
 	stats.seeders  = 0;
 	stats.leechers = 0;
 	db->load_peers(torrents_list, users_list);
+	track_loaded();
+	rebuild_torrent_filter();
 	db->load_blacklist(blacklist);
 	status = OPEN;
 }
@@ -73,9 +83,9 @@ bool worker::shutdown() {
 		while(reaper_active) {
 			std::this_thread::sleep_for(std::chrono::seconds(1));
 		}
+		full_scrape_cache.stop();
 		torrents_list.clear();
 		users_list.clear();
-		domains_list.clear();
 
 		delete &torrents_list;
 		delete &users_list;
@@ -90,8 +100,10 @@ bool worker::shutdown() {
 	}
 }
 
-std::string worker::work(const std::string &input, std::string &ip, uint16_t &ip_ver, client_opts_t &client_opts) {
+std::string worker::work(const std::string &input, const ip_address &client_addr, client_opts_t &client_opts) {
 	unsigned int input_length = input.length();
+	rcu_read_guard rcu_guard; // Covers every snapshot read while handling this request
+	const tracker_config *cfg = conf->get();
 
 	//---------- Parse request - ugly but fast. Using substr exploded.
 	if (input_length < 60) { // Way too short to be anything useful
@@ -108,7 +120,7 @@ std::string worker::work(const std::string &input, std::string &ip, uint16_t &ip
 	// Check if we have anonymous function enabled.
 	// If that is the case, we use the default hash (set in configuration), to keep track of anonymous traffic.
 	// If the user doesn't exist in the database, it should be created, otherwise the tracker will still give a error.
-	if (!anonymous) {
+	if (!cfg->anonymous) {
 	if (input[37] != '/') {
 	    // just handle robots.txt if announce is malformed.
 		// robots.txt requested?
@@ -128,7 +140,7 @@ std::string worker::work(const std::string &input, std::string &ip, uint16_t &ip
 				return "User-agent: *\nDisallow: /";
 
 			pos = 5;
-			passkey = anonymous_password;
+			passkey = cfg->anonymous_password;
 		} else {
 			for (; pos < 37; pos++) {
 				passkey.push_back(input[pos]);
@@ -245,7 +257,7 @@ std::string worker::work(const std::string &input, std::string &ip, uint16_t &ip
 		}
 	}
 
-	if (keepalive_enabled) {
+	if (cfg->keepalive_timeout != 0) {
 		auto hdr_http_close = headers.find("connection");
 		if (hdr_http_close == headers.end()) {
 			client_opts.http_close = (http_version == "1.0");
@@ -265,7 +277,7 @@ std::string worker::work(const std::string &input, std::string &ip, uint16_t &ip
 	}
 
 	if (action == UPDATE) {
-		if (passkey == site_password) {
+		if (passkey == cfg->site_password) {
 			return update(params, client_opts);
 		} else {
 			return response_error("Authentication failure", client_opts);
@@ -273,9 +285,25 @@ std::string worker::work(const std::string &input, std::string &ip, uint16_t &ip
 	}
 
 	if (action == REPORT) {
-		if (passkey == report_password) {
-			std::lock_guard<std::mutex> ul_lock(db->user_list_mutex);
-			std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		if (passkey == cfg->report_password) {
+			if (params["get"] == "scrape") {
+				// Prebuilt in the background, the torrent list isn't touched
+				return full_scrape_cache.serve(headers, client_opts);
+			}
+			if (params["get"] == "metrics" || params["get"] == "locks") {
+				// Rendered from atomic counters alone, no need to stop announces
+				return report(params, torrents_list, users_list, domains_list, client_opts);
+			}
+			if (params["get"] == "memory") {
+				// Estimated from counts, the lists are only locked to read their sizes
+				std::vector<memory_usage> usage;
+				get_memory_usage(usage);
+				db->get_memory_usage(usage);
+				usage.push_back(connection_memory_usage());
+				return memory_report(usage, client_opts);
+			}
+			std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
+			std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 			return report(params, torrents_list, users_list, domains_list, client_opts);
 		} else {
 			return response_error("Authentication failure", client_opts);
@@ -284,52 +312,50 @@ std::string worker::work(const std::string &input, std::string &ip, uint16_t &ip
 
 	// Either a scrape or an announce
 
-	std::unique_lock<std::mutex> ul_lock(db->user_list_mutex);
-	auto user_it = users_list.find(passkey);
-	if (user_it == users_list.end()) {
+	// Lives in the passkey table snapshot, which our rcu_read_guard keeps around
+	const user_ptr *u = passkeys.find(passkey);
+	if (u == nullptr) {
 		syslog(trace) << "Passkey not found " << passkey;
 		return response_error("Passkey not found", client_opts);
 	}
-	user_ptr u = user_it->second;
-	ul_lock.unlock();
 
 	if (action == ANNOUNCE) {
-		std::string host = get_host(headers);
-		std::unique_lock<std::mutex> dl_lock(db->domain_list_mutex);
-		auto domain_it = domains_list.find(host);
-		if (domain_it == domains_list.end()) {
-			domain_ptr tmp_domain = std::make_shared<domain>(host);
-			domains_list.insert(std::pair<std::string, domain_ptr>(host, tmp_domain));
-			domain_it = domains_list.find(host);
-		}
-		domain_ptr d = domain_it->second;
-		dl_lock.unlock();
+		domain_id d = get_domain(headers);
 
 		// Let's translate the infohash into something nice
 		// info_hash is a url encoded (hex) base 20 number
-		std::string info_hash_decoded = hex_decode(params["info_hash"]);
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::string info_hash_decoded(20, '\0');
+		if (!hash_decode(params["info_hash"], &info_hash_decoded[0])) {
+			return response_error("Invalid info hash", client_opts);
+		}
+		if (!known_torrents.may_contain(info_hash_decoded)) {
+			// Deleted or never there, no need to lock the torrent list
+			return unregistered(info_hash_decoded, client_opts);
+		}
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		auto tor = torrents_list.find(info_hash_decoded);
 		if (tor == torrents_list.end()) {
-			std::lock_guard<std::mutex> dr_lock(del_reasons_lock);
-			auto msg = del_reasons.find(info_hash_decoded);
-			if (msg != del_reasons.end()) {
-				if (msg->second.reason != -1) {
-					return response_error("Unregistered torrent: " + get_del_reason(msg->second.reason), client_opts);
-				} else {
-					return response_error("Unregistered torrent", client_opts);
-				}
-			} else {
-				return response_error("Unregistered torrent", client_opts);
-			}
+			return unregistered(info_hash_decoded, client_opts);
 		}
-		return announce(input, tor->second, u, d, params, headers, ip, ip_ver, client_opts);
+		return announce(input, tor->second, *u, d, params, headers, client_addr, client_opts);
 	} else {
 		return scrape(infohashes, headers, client_opts);
 	}
 }
 
-std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u, domain_ptr &d, params_type &params, params_type &headers, std::string &ip, uint16_t &ip_ver, client_opts_t &client_opts) {
+// The binary form of a parsed address, empty if there is none or it isn't public
+static std::string public_address(const ip_address &addr) {
+	if (addr.version == 0) {
+		return "";
+	}
+	if (!addr.is_public) {
+		syslog(trace) << "Rejecting IP: " << ip_to_string(addr.binary());
+		return "";
+	}
+	return addr.binary();
+}
+
+std::string worker::announce(const std::string &input, torrent &tor, const user_ptr &u, domain_id d, params_type &params, params_type &headers, const ip_address &client_addr, client_opts_t &client_opts) {
 	cur_time = time(NULL);
 
 	if (params["compact"] != "1") {
@@ -351,35 +377,22 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 	bool expire_token = false; // Whether or not to expire a token after torrent completion
 	bool peer_changed = false; // Whether or not the peer is new or has changed since the last announcement
 	bool inc_l = false, inc_s = false, dec_l = false, dec_s = false;
-	bool sitewide_freeleech = false;
-	bool sitewide_doubleseed = false;
 	userid_t userid = u->get_id();
-	std::string ipv4 = "", ipv6 = "", public_ipv4 = "", public_ipv6 = "";
-
-	if (ip_ver == 4){
-		ipv4=ip;
-		public_ipv4=ip;
-	} else {
-		ipv6=ip;
-		public_ipv6=ip;
+	// Where the peer can be reached and the address reported back as its external ip
+	ip_address addr4 = {}, addr6 = {}, public_addr4 = {}, public_addr6 = {};
+	if (client_addr.version == 4) {
+		addr4 = public_addr4 = client_addr;
+	} else if (client_addr.version == 6) {
+		addr6 = public_addr6 = client_addr;
 	}
 
 	time_t now;
 	time(&now);
 
-	if (((opts->get_time("SitewideFreeleechStartTime") <= now) &&
-	     (opts->get_time("SitewideFreeleechEndTime")   >= now) &&
-		 (opts->get_str("SitewideFreeleechMode")   == "timed")) ||
-		 (opts->get_str("SitewideFreeleechMode")   == "perma")) {
-		sitewide_freeleech = true;
-	}
-
-	if (((opts->get_time("SitewideDoubleseedStartTime") <= now) &&
-	     (opts->get_time("SitewideDoubleseedEndTime")   >= now) &&
-		 (opts->get_str("SitewideDoubleseedMode")   == "timed")) ||
-		 (opts->get_str("SitewideDoubleseedMode")   == "perma")) {
-		sitewide_doubleseed = true;
-	}
+	const tracker_config *cfg = conf->get();
+	const site_promos *promos = opts->get_promos();
+	bool sitewide_freeleech = promos->freeleech.active(now);
+	bool sitewide_doubleseed = promos->doubleseed.active(now);
 
 	// Filter shitty clients here
 	params_type::const_iterator peer_id_iterator = params.find("peer_id");
@@ -387,8 +400,8 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 	if (peer_id_iterator == params.end()) {
 		return response_error("No peer ID", client_opts);
 	}
-	const std::string peer_id = hex_decode(peer_id_iterator->second);
-	if (peer_id.length() != 20) {
+	std::string peer_id(20, '\0');
+	if (!hash_decode(peer_id_iterator->second, &peer_id[0])) {
 		return response_error("Invalid peer ID", client_opts);
 	}
 
@@ -400,22 +413,11 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 		return response_error("Anonymous client", client_opts);
 	}
 
-	std::unique_lock<std::mutex> wl_lock(db->blacklist_mutex);
-	if (blacklist.size() > 0) {
-		bool found = false; // Found client in blacklist?
-		for (unsigned int i = 0; i < blacklist.size(); i++) {
-			if (peer_id.compare(0, blacklist[i].length(), blacklist[i]) == 0) {
-				found = true;
-				break;
-			}
-		}
-		if (found) {
-			return response_error("Your client is blacklisted!", client_opts);
-		}
+	if (blacklist.matches(peer_id)) {
+		return response_error("Your client is blacklisted!", client_opts);
 	}
-	wl_lock.unlock();
 
-	std::stringstream peer_key_stream;
+	string_builder peer_key_stream;
 	peer_key_stream << peer_id[12 + (tor.id & 7)] // "Randomize" the element order in the peer map by prefixing with a peer id byte
 		<< userid // Include user id in the key to lower chance of peer id collisions
 		<< peer_id;
@@ -478,6 +480,24 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 	}
 	p = &peer_it->second;
 
+	// For the rejections below. A peer added by this announce is dropped again, one
+	// moved between the lists stays and must be on the wheel so the reaper finds it.
+	auto reject = [&](const std::string &reason) -> std::string {
+		if (inserted) {
+			if (p->paused) {
+				tor.paused--;
+			}
+			if (left > 0) {
+				tor.leechers.erase(peer_it);
+			} else {
+				tor.seeders.erase(peer_it);
+			}
+		} else if (!p->expiry.linked()) {
+			track_peer(tor, *peer_it, p->last_announced + cfg->peers_timeout + 1);
+		}
+		return response_error(reason, client_opts);
+	};
+
 	int64_t upspeed = 0;
 	int64_t downspeed = 0;
 	int64_t real_uploaded_change = 0;
@@ -499,8 +519,8 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 		// New peer on this torrent (maybe)
 		update_torrent = true;
 		if (inserted) {
-			// If this was an existing peer, the user pointer will be corrected later
-			p->user = u;
+			// If this was an existing peer, the user reference will be corrected later
+			p->user = u->ref();
 			p->domain = d;
 		}
 
@@ -562,14 +582,14 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 
 			if (sit != tor.tokened_users.end()) {
 				//expire_token = true;
-				std::stringstream record;
+				string_builder record;
 				record << '('
 									<< userid << ','
 									<< tor.id << ','
 									<< downloaded_change << ','
 									<< uploaded_change
 							 << ')';
-				std::string record_str = record.str();
+				const std::string &record_str = record.str();
 				db->record_token(record_str);
 			}
 
@@ -594,7 +614,7 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 			}
 
 			if (uploaded_change || downloaded_change || real_uploaded_change || real_downloaded_change) {
-				std::stringstream record;
+				string_builder record;
 				record << '('
 									<< userid << ','
 									<< uploaded_change << ','
@@ -602,7 +622,7 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 									<< real_uploaded_change << ','
 									<< real_downloaded_change
 							 << ')';
-				std::string record_str = record.str();
+				const std::string &record_str = record.str();
 				db->record_user(record_str);
 			}
 		}
@@ -611,103 +631,60 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 
   // Reject leech forbidden peers early
 	if (!u->can_leech() && left > 0) {
-		return response_error("Access denied, leeching forbidden", client_opts);
+		return reject("Access denied, leeching forbidden");
 	}
 
 	auto param_ip = params.find("ip");
 	if (param_ip != params.end()) {
-		std::string ip = param_ip->second;
-		struct addrinfo hint, *res = NULL;
-		memset(&hint, 0, sizeof hint);
-		hint.ai_family = PF_UNSPEC;
-		hint.ai_flags = AI_NUMERICHOST;
-		int err = getaddrinfo(ip.c_str(), NULL, &hint, &res);
-		if (err != 0) {
-			syslog(trace) << "Error parsing IP parameter from announce: "
-			<< param_ip->second << " " << gai_strerror(err);
+		ip_address param_addr;
+		if (!parse_ip(param_ip->second, param_addr)) {
+			syslog(trace) << "Error parsing IP parameter from announce: " << param_ip->second;
+		} else if (param_addr.version == 4) {
+			addr4 = param_addr;
 		} else {
-			if(res->ai_family == AF_INET) {
-				ipv4 = param_ip->second;
-			} else if (res->ai_family == AF_INET6) {
-				ipv6 = param_ip->second;
-			}
-			freeaddrinfo(res);
-		}
-	}
-
-	if (!real_ip_header.empty()) {
-		auto header_ip = headers.find(real_ip_header);
-	    if (header_ip != headers.end()) {
-		    std::string ip = header_ip->second;
-		    ip = ip.substr(0, ip.find(','));
-		    struct addrinfo hint, *res = NULL;
-		    memset(&hint, 0, sizeof hint);
-		    hint.ai_family = PF_UNSPEC;
-		    hint.ai_flags = AI_NUMERICHOST;
-		    int err = getaddrinfo(ip.c_str(), NULL, &hint, &res);
-		    if (err != 0) {
-				syslog(trace) << "Error parsing " << real_ip_header << " header: "
-			    << header_ip->second << " " << gai_strerror(err);
-		    } else {
-			    if(res->ai_family == AF_INET) {
-				    ipv4 = ip;
-				    public_ipv4=ip;
-			    } else if (res->ai_family == AF_INET6) {
-				    ipv6 = ip;
-				    public_ipv6=ip;
-			    }
-			    freeaddrinfo(res);
-			}
+			addr6 = param_addr;
 		}
 	}
 
-	if ((param_ip = params.find("ipv4")) != params.end()) ipv4 = param_ip->second;
-	if ((param_ip = params.find("ipv6")) != params.end()) ipv6 = param_ip->second;
-
-	// Convert IPs to Binary representations
-	struct sockaddr_in sa;
-	if(inet_pton(AF_INET, hex_decode(ipv4).c_str(), &(sa.sin_addr)) != -1 && !ipv4.empty()){
-		// IP is 4 bytes for IPv4
-		if (ipv4_is_public(sa.sin_addr)) {
-			ipv4.assign(reinterpret_cast<const char*>(&sa.sin_addr.s_addr), 4);
-		} else {
-			syslog(trace) << "Rejecting IP: " << hex_decode(ipv4);
-			ipv4.clear();
-		}
-	}
-	struct sockaddr_in public_sa;
-	if(inet_pton(AF_INET, hex_decode(public_ipv4).c_str(), &(public_sa.sin_addr)) != -1 && !public_ipv4.empty()){
-		// IP is 4 bytes for IPv4
-		if (ipv4_is_public(public_sa.sin_addr)) {
-			public_ipv4.assign(reinterpret_cast<const char*>(&public_sa.sin_addr.s_addr), 4);
-		} else {
-			syslog(trace) << "Rejecting IP: " << hex_decode(public_ipv4);
-			public_ipv4.clear();
+	if (!cfg->real_ip_header.empty()) {
+		auto header_ip = headers.find(cfg->real_ip_header);
+		if (header_ip != headers.end()) {
+			ip_address header_addr;
+			if (!parse_first_hop(header_ip->second, header_addr)) {
+				syslog(trace) << "Error parsing " << cfg->real_ip_header << " header: " << header_ip->second;
+			} else if (header_addr.version == 4) {
+				addr4 = public_addr4 = header_addr;
+			} else {
+				addr6 = public_addr6 = header_addr;
+			}
 		}
 	}
-	struct sockaddr_in6 sa6;
-	if(inet_pton(AF_INET6, hex_decode(ipv6).c_str(), &(sa6.sin6_addr)) != -1 && !ipv6.empty()){
-		// IP is 16 bytes for IPv6
-		if (ipv6_is_public(sa6.sin6_addr)) {
-			ipv6.assign(reinterpret_cast<const char*>(&sa6.sin6_addr.s6_addr), 16);
+
+	if ((param_ip = params.find("ipv4")) != params.end()) {
+		ip_address param_addr;
+		if (parse_ip(param_ip->second, param_addr) && param_addr.version == 4) {
+			addr4 = param_addr;
 		} else {
-			syslog(trace) << "Rejecting IP: " << hex_decode(ipv6);
-			ipv6.clear();
+			syslog(trace) << "Error parsing ipv4 parameter from announce: " << param_ip->second;
 		}
 	}
-	struct sockaddr_in6 public_sa6;
-	if(inet_pton(AF_INET6, hex_decode(public_ipv6).c_str(), &(public_sa6.sin6_addr)) != -1 && !public_ipv6.empty()){
-		// IP is 16 bytes for IPv6
-		if (ipv6_is_public(public_sa6.sin6_addr)) {
-			public_ipv6.assign(reinterpret_cast<const char*>(&public_sa6.sin6_addr.s6_addr), 16);
+	if ((param_ip = params.find("ipv6")) != params.end()) {
+		ip_address param_addr;
+		if (parse_ip(param_ip->second, param_addr) && param_addr.version == 6) {
+			addr6 = param_addr;
 		} else {
-			syslog(trace) << "Rejecting IP: " << hex_decode(public_ipv6);
-			public_ipv6.clear();
+			syslog(trace) << "Error parsing ipv6 parameter from announce: " << param_ip->second;
 		}
 	}
 
+	// Binary representations, 4 bytes for IPv4 and 16 for IPv6
+	std::string ipv4 = public_address(addr4);
+	std::string ipv6 = public_address(addr6);
+	std::string public_ipv4 = public_address(public_addr4);
+	std::string public_ipv6 = public_address(public_addr6);
+
 	if (ipv4.empty() && ipv6.empty()) {
-		return response_error("Invalid IP detected", client_opts);
+		return reject("Invalid IP detected");
 	}
 
 	uint16_t port = strtoint32(params["port"]) & 0xFFFF;
@@ -746,12 +723,12 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 
 	// Add peer data to the database
 	if (peer_changed) {
-		std::stringstream record;
+		string_builder record;
 		record << userid << ',' << tor.id << ',' << active << ','
 		       << uploaded << ',' << downloaded << ',' << upspeed << ',' << downspeed << ','
 		       << left << ',' << corrupt << ',' << (cur_time - p->first_announced) << ','
 		       << p->first_announced << ',' << p->last_announced << ',' << p->announces << ',';
-		std::string record_str = record.str();
+		const std::string &record_str = record.str();
 		std::string record_ipv4, record_ipv6;
 		if (u->is_protected()) {
 			record_ipv4 = "";
@@ -763,19 +740,19 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 
 		db->record_peer(record_str, record_ipv4, record_ipv6, port, peer_id, headers["user-agent"]);
 	} else {
-		std::stringstream record;
+		string_builder record;
 		record << userid << ',' << tor.id << ',' << (cur_time - p->first_announced)
 		       << ',' << p->last_announced << ',' << p->announces << ',';
-		std::string record_str = record.str();
+		const std::string &record_str = record.str();
 		db->record_peer(record_str, peer_id);
 	}
 
 	if (real_uploaded_change > 0 || real_downloaded_change > 0) {
-		std::stringstream record;
+		string_builder record;
 		record << userid << ',' << real_downloaded_change << ',' << left << ','
 					 << real_uploaded_change << ',' << upspeed << ',' << downspeed << ','
 					 << (cur_time - p->first_announced);
-		std::string record_str = record.str();
+		const std::string &record_str = record.str();
 		db->record_peer_hist(record_str, peer_id, ipv4, ipv6, tor.id);
 	}
 
@@ -784,9 +761,9 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 	uint32_t numwant;
 	params_type::const_iterator param_numwant = params.find("numwant");
 	if (param_numwant == params.end()) {
-		numwant = numwant_limit;
+		numwant = cfg->numwant_limit;
 	} else {
-		numwant = std::min((int32_t)numwant_limit, strtoint32(param_numwant->second));
+		numwant = std::min((int32_t)cfg->numwant_limit, strtoint32(param_numwant->second));
 	}
 
 	if (stopped_torrent) {
@@ -809,9 +786,9 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 			record_ipv4 = ipv4;
 			record_ipv6 = ipv6;
 		}
-		std::stringstream record;
+		string_builder record;
 		record << userid << ',' << tor.id << ',' << cur_time;
-		std::string record_str = record.str();
+		const std::string &record_str = record.str();
 		db->record_snatch(record_str, record_ipv4, record_ipv6);
 
 		// User is a seeder now!
@@ -868,17 +845,19 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 						i = tor.seeders.begin();
 					}
 
-					// Don't show users themselves or staff (leech disabled seeders are fine)
-					if ((i->second.ipv4_port == p->ipv4_port && !p->ipv4_port.empty()) ||
+					// Don't show users themselves, removed users or staff (leech disabled seeders are fine)
+					user_ptr peer_user = user_arena::get(i->second.user);
+					if (peer_user == nullptr ||
+						(i->second.ipv4_port == p->ipv4_port && !p->ipv4_port.empty()) ||
 						(i->second.ipv6_port == p->ipv6_port && !p->ipv6_port.empty())||
-						i->second.user->get_id() == userid || !i->second.visible) {
+						peer_user->get_id() == userid || !i->second.visible) {
 						++i;
 						continue;
 					}
 
 					// Only show IPv6 peers to other IPv6 peers
 					if ((!p->ipv6.empty()) && (!i->second.ipv6_port.empty()) &&
-					     opts->get_bool("EnableIPv6Tracker") && i->second.user->track_ipv6()) {
+					     promos->ipv6_tracker && peer_user->track_ipv6()) {
 						peers6.append(i->second.ipv6_port);
 						found_peers++;
 					} else if (!i->second.ipv4_port.empty()) {
@@ -925,17 +904,18 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 				}
 
 				// Don't show users themselves, leech disabled users or staff
-				if (i->second.user->is_deleted() ||
+				user_ptr peer_user = user_arena::get(i->second.user);
+				if (peer_user == nullptr || peer_user->is_deleted() ||
 				    (i->second.ipv4_port == p->ipv4_port && !p->ipv4_port.empty()) ||
 					(i->second.ipv6_port == p->ipv6_port && !p->ipv6_port.empty())||
-					i->second.user->get_id() == userid || !i->second.visible) {
+					peer_user->get_id() == userid || !i->second.visible) {
 					++i;
 					continue;
 				}
 
 				// Only show IPv6 peers to other IPv6 peers
 				if ((!p->ipv6.empty()) && (!i->second.ipv6_port.empty()) &&
-				     opts->get_bool("EnableIPv6Tracker") && i->second.user->track_ipv6()) {
+				     promos->ipv6_tracker && peer_user->track_ipv6()) {
 					peers6.append(i->second.ipv6_port);
 					found_peers++;
 				} else if (!i->second.ipv4_port.empty()) {
@@ -954,80 +934,73 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 	stats.succ_announcements++;
 
 	if (dec_l || dec_s || inc_l || inc_s) {
+		user_ptr peer_user = user_arena::get(p->user);
+		if (peer_user != nullptr) {
+			if (inc_l) {
+				peer_user->incr_leeching();
+			}
+			if (inc_s) {
+				peer_user->incr_seeding();
+			}
+			if (dec_l) {
+				peer_user->decr_leeching();
+			}
+			if (dec_s) {
+				peer_user->decr_seeding();
+			}
+		}
+		domains_list.peers_changed(p->domain, (inc_l + inc_s) - (dec_l + dec_s));
 		if (inc_l) {
-			p->user->incr_leeching();
 			stats.leechers++;
 		}
 		if (inc_s) {
-			p->user->incr_seeding();
 			stats.seeders++;
 		}
 		if (dec_l) {
-			p->user->decr_leeching();
 			stats.leechers--;
 		}
 		if (dec_s) {
-			p->user->decr_seeding();
 			stats.seeders--;
 		}
 		if (inc_l || inc_s) {
-			if(!p->ipv6.empty()){
-				char str[INET6_ADDRSTRLEN];
-				struct sockaddr_in6 sa6;
-				inet_ntop(AF_INET6, p->ipv6.c_str(), str, INET6_ADDRSTRLEN);
-				inet_pton(AF_INET6, str, &(sa6.sin6_addr));
-				if (ipv6_is_public(sa6.sin6_addr)) {
-					stats.ipv6_peers++;
-					syslog(trace) << "Peer with IPv6 address " << str << " added.";
-				}
+			if (!p->ipv6.empty() && ipv6_is_public(reinterpret_cast<const uint8_t*>(p->ipv6.data()))) {
+				stats.ipv6_peers++;
+				syslog(trace) << "Peer with IPv6 address " << ip_to_string(p->ipv6) << " added.";
 			}
-			if(!p->ipv4.empty()){
-				char str[INET_ADDRSTRLEN];
-				struct sockaddr_in sa;
-				inet_ntop(AF_INET, p->ipv4.c_str(), str, INET_ADDRSTRLEN);
-				inet_pton(AF_INET, str, &(sa.sin_addr));
-				if (ipv4_is_public(sa.sin_addr)) {
-					stats.ipv4_peers++;
- 					syslog(trace) << "Peer with IPv4 address " << str << " added.";
-				}
+			if (!p->ipv4.empty() && ipv4_is_public(reinterpret_cast<const uint8_t*>(p->ipv4.data()))) {
+				stats.ipv4_peers++;
+				syslog(trace) << "Peer with IPv4 address " << ip_to_string(p->ipv4) << " added.";
 			}
 		}
 		if (dec_l || dec_s) {
-			if(!p->ipv6.empty()){
-				char str[INET6_ADDRSTRLEN];
-				struct sockaddr_in6 sa6;
-				inet_ntop(AF_INET6, p->ipv6.c_str(), str, INET6_ADDRSTRLEN);
-				inet_pton(AF_INET6, str, &(sa6.sin6_addr));
-				if (ipv6_is_public(sa6.sin6_addr)) {
-					stats.ipv6_peers--;
-					syslog(trace) << "Peer with IPv6 address " << str << " removed." ;
-				}
+			if (!p->ipv6.empty() && ipv6_is_public(reinterpret_cast<const uint8_t*>(p->ipv6.data()))) {
+				stats.ipv6_peers--;
+				syslog(trace) << "Peer with IPv6 address " << ip_to_string(p->ipv6) << " removed.";
 			}
-			if(!p->ipv4.empty()){
-				char str[INET_ADDRSTRLEN];
-				struct sockaddr_in sa;
-				inet_ntop(AF_INET, p->ipv4.c_str(), str, INET_ADDRSTRLEN);
-				inet_pton(AF_INET, str, &(sa.sin_addr));
-				if (ipv4_is_public(sa.sin_addr)) {
-					stats.ipv4_peers--;
- 					syslog(trace) << "Peer with IPv4 address " << str << " removed.";
-				}
+			if (!p->ipv4.empty() && ipv4_is_public(reinterpret_cast<const uint8_t*>(p->ipv4.data()))) {
+				stats.ipv4_peers--;
+				syslog(trace) << "Peer with IPv4 address " << ip_to_string(p->ipv4) << " removed.";
 			}
 		}
 	}
 
 	// Correct the stats for the old user if the peer's user link has changed
-	if (p->user != u) {
+	if (p->user != u->ref()) {
 		if (!stopped_torrent) {
+			user_ptr old_user = user_arena::get(p->user);
 			if (left > 0) {
 				u->incr_leeching();
-				p->user->decr_leeching();
+				if (old_user != nullptr) {
+					old_user->decr_leeching();
+				}
 			} else {
 				u->incr_seeding();
-				p->user->decr_seeding();
+				if (old_user != nullptr) {
+					old_user->decr_seeding();
+				}
 			}
 		}
-		p->user = u;
+		p->user = u->ref();
 	}
 
 	// Delete peers as late as possible to prevent access problems
@@ -1037,13 +1010,16 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 		} else {
 			tor.seeders.erase(peer_it);
 		}
+	} else if (!p->expiry.linked()) {
+		// New, or copied over from the other peer list
+		track_peer(tor, *peer_it, p->last_announced + cfg->peers_timeout + 1);
 	}
 
 	// Putting this after the peer deletion gives us accurate swarm sizes
 	if (update_torrent || tor.last_flushed + 3600 < cur_time) {
 		tor.last_flushed = cur_time;
 
-		std::stringstream record;
+		string_builder record;
 		record << '('
 							<< tor.id << ','
 							<< tor.seeders.size() << ','
@@ -1051,69 +1027,100 @@ std::string worker::announce(const std::string &input, torrent &tor, user_ptr &u
 							<< snatched << ','
 					 		<< tor.balance
 					 << ')';
-		std::string record_str = record.str();
+		const std::string &record_str = record.str();
 		db->record_torrent(record_str);
 	}
 
 	// Bit torrent spec mandates that the keys are sorted.
-
-	std::string output = "d";
-	output.reserve(350);
-	output += bencode_str("complete")   + bencode_int(tor.seeders.size());
-	output += bencode_str("downloaded") + bencode_int(tor.completed);
+	response_writer &writer = thread_response_writer();
+	writer.begin(client_opts, 200);
+	writer.raw('d');
+	writer.str("complete");
+	writer.integer(tor.seeders.size());
+	writer.str("downloaded");
+	writer.integer(tor.completed);
 
 	if (!public_ipv6.empty()) {
-		output += bencode_str("external ip") + bencode_str(public_ipv6);
+		writer.str("external ip");
+		writer.str(public_ipv6);
 	} else 	if (!public_ipv4.empty()) {
-		output += bencode_str("external ip") + bencode_str(public_ipv4);
+		writer.str("external ip");
+		writer.str(public_ipv4);
 	}
 
-	output += bencode_str("incomplete")   + bencode_int(tor.leechers.size());
-	output += bencode_str("interval")     + bencode_int(announce_interval + std::min((size_t)600, tor.seeders.size())); // ensure a more even distribution of announces/second
-	output += bencode_str("min interval") + bencode_int(announce_interval);
-	output += bencode_str("peers") + bencode_str(peers);
-
-	if (!peers6.empty())
-			output += bencode_str("peers6") + bencode_str(peers6);
-	output += "e";
+	writer.str("incomplete");
+	writer.integer(tor.leechers.size());
+	writer.str("interval");
+	writer.integer(cfg->announce_interval + std::min((size_t)600, tor.seeders.size())); // ensure a more even distribution of announces/second
+	writer.str("min interval");
+	writer.integer(cfg->announce_interval);
+	writer.str("peers");
+	writer.str(peers);
+
+	if (!peers6.empty()) {
+		writer.str("peers6");
+		writer.str(peers6);
+	}
+	writer.raw('e');
 
 	/* gzip compression actually makes announce returns larger from our
 	 * testing. Feel free to enable this here if you'd like but be aware of
-	 * possibly inflated return size
+	 * possibly inflated return size. It has to be decided before begin().
 	 */
-	/*if (headers["accept-encoding"].find("gzip") != std::string::npos) {
-		client_opts.gzip = true;
-	}*/
-	return response(output, client_opts, 200);
+	return writer.finish();
 }
 
-std::string worker::scrape(const std::list<std::string> &infohashes, params_type &headers, client_opts_t &client_opts) {
-	std::string output = "d" + bencode_str("files") + "d";
-	for (std::list<std::string>::const_iterator i = infohashes.begin(); i != infohashes.end(); ++i) {
-		std::string infohash = *i;
-		infohash = hex_decode(infohash);
-
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
-		torrent_list::iterator tor = torrents_list.find(infohash);
-		if (tor == torrents_list.end()) {
-			continue;
-		}
-		torrent *t = &(tor->second);
-
-		output += bencode_str(infohash);
-		output += "d";
-		output += bencode_str("complete")    + bencode_int(t->seeders.size());
-		output += bencode_str("downloaded")  + bencode_int(t->completed);
-		output += bencode_str("incomplete")  + bencode_int(t->leechers.size());
-		output += bencode_str("downloaders") + bencode_int(t->leechers.size() - t->paused);
-		output += "e";
+// The bencoded scrape entry of a torrent, only rebuilt when its counts changed.
+// Needs the torrent list lock.
+static const std::string &scrape_fragment(const std::string &infohash, torrent &t) {
+	scrape_cache_t &cache = t.scrape_cache;
+	if (cache.fragment.empty() || cache.seeders != t.seeders.size() || cache.leechers != t.leechers.size()
+			|| cache.completed != t.completed || cache.paused != t.paused) {
+		cache.seeders = t.seeders.size();
+		cache.leechers = t.leechers.size();
+		cache.completed = t.completed;
+		cache.paused = t.paused;
+
+		cache.fragment.clear();
+		append_scrape_entry(cache.fragment, infohash.data(), cache.seeders, cache.completed, cache.leechers,
+			static_cast<int64_t>(cache.leechers) - cache.paused);
 	}
-	output += "ee";
+	return cache.fragment;
+}
+
+std::string worker::scrape(const std::list<std::string> &infohashes, params_type &headers, client_opts_t &client_opts) {
 	if (headers["accept-encoding"].find("gzip") != std::string::npos) {
 		client_opts.gzip = true;
 	}
 
-	return response(output, client_opts, 200);
+	// Decode everything first so the torrent list is only locked once
+	std::vector<std::string> decoded;
+	decoded.reserve(infohashes.size());
+	for (std::list<std::string>::const_iterator i = infohashes.begin(); i != infohashes.end(); ++i) {
+		std::string infohash(20, '\0');
+		if (hash_decode(*i, &infohash[0])) {
+			decoded.push_back(std::move(infohash));
+		}
+	}
+
+	response_writer &writer = thread_response_writer();
+	writer.begin(client_opts, 200);
+	writer.raw('d');
+	writer.str("files");
+	writer.raw('d');
+	{
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
+		for (const std::string &infohash: decoded) {
+			torrent_list::iterator tor = torrents_list.find(infohash);
+			if (tor == torrents_list.end()) {
+				continue;
+			}
+			const std::string &fragment = scrape_fragment(tor->first, tor->second);
+			writer.raw(fragment.data(), fragment.size());
+		}
+	}
+	writer.raw("ee");
+	return writer.finish();
 }
 
 //TODO: Restrict to local IPs
@@ -1133,7 +1140,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 	} else if (params["action"] == "change_passkey") {
 		std::string oldpasskey = params["oldpasskey"];
 		std::string newpasskey = params["newpasskey"];
-		std::lock_guard<std::mutex> ul_lock(db->user_list_mutex);
+		std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
 		auto u = users_list.find(oldpasskey);
 		if (u == users_list.end()) {
 			syslog(error) << "No user with passkey " << oldpasskey << " exists when attempting to change passkey to " << newpasskey;
@@ -1141,6 +1148,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		} else {
 			userid_t userid = u->second->get_id();
 			users_list[newpasskey] = u->second;
+			passkeys.update({{newpasskey, u->second}, {oldpasskey, nullptr}});
 			users_list.erase(oldpasskey);
 			syslog(debug) << "Changed passkey from " << oldpasskey << " to " << newpasskey << " for user " << userid;
 		}
@@ -1148,13 +1156,14 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		torrent *t;
 		std::string info_hash = params["info_hash"];
 		info_hash = hex_decode(info_hash);
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		auto i = torrents_list.find(info_hash);
 
 		// Torrent may have been added already with a failed upload, check the
 		// torrents hashmap to see if it exists and if not add it.
 		if (i == torrents_list.end()) {
 			t = &torrents_list[info_hash];
+			known_torrents.add(info_hash, torrents_list);
 		} else {
 			t = &i->second;
 		}
@@ -1164,8 +1173,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		t->paused = 0;
 		t->balance = 0;
 		t->last_flushed = 0;
-		t->seeders.clear();
-		t->leechers.clear();
+		drop_peers(*t);
 		t->last_selected_seeder = "";
 		t->last_selected_leecher = "";
 		t->tokened_users.clear();
@@ -1206,7 +1214,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		} else {
 			ds = NORMAL;
 		}
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		auto torrent_it = torrents_list.find(info_hash);
 		if (torrent_it != torrents_list.end()) {
 			torrent_it->second.free_torrent   = fl;
@@ -1236,7 +1244,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		} else {
 			ds = NORMAL;
 		}
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		for (unsigned int pos = 0; pos < info_hashes.length(); pos += 20) {
 			std::string info_hash = info_hashes.substr(pos, 20);
 			auto torrent_it = torrents_list.find(info_hash);
@@ -1251,7 +1259,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 	} else if (params["action"] == "add_token_fl") {
 		std::string info_hash = hex_decode(params["info_hash"]);
 		int userid = atoi(params["userid"].c_str());
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		auto torrent_it = torrents_list.find(info_hash);
 		time_t time = (time_t)atoi(params["time"].c_str());
 
@@ -1264,7 +1272,10 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 			    slots_t slots;
 			    slots.free_leech = time;
 			    slots.double_seed = 0;
-			    torrent_it->second.tokened_users.insert(std::pair<int, slots_t>(userid, slots));
+			    sit = torrent_it->second.tokened_users.insert(std::pair<int, slots_t>(userid, slots)).first;
+			}
+			if (!sit->second.expiry.linked()) {
+				track_token(torrent_it->second, userid, sit->second);
 			}
 		} else {
 			syslog(error) << "Failed to find torrent to add a token for user " << userid;
@@ -1273,7 +1284,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 	} else if (params["action"] == "add_token_ds") {
 		std::string info_hash = hex_decode(params["info_hash"]);
 		int userid = atoi(params["userid"].c_str());
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		auto torrent_it = torrents_list.find(info_hash);
 		time_t time = (time_t)atoi(params["time"].c_str());
 
@@ -1286,7 +1297,10 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 			    slots_t slots;
 			    slots.free_leech = 0;
 			    slots.double_seed = time;
-			    torrent_it->second.tokened_users.insert(std::pair<int, slots_t>(userid, slots));
+			    sit = torrent_it->second.tokened_users.insert(std::pair<int, slots_t>(userid, slots)).first;
+			}
+			if (!sit->second.expiry.linked()) {
+				track_token(torrent_it->second, userid, sit->second);
 			}
 		} else {
 			syslog(error) << "Failed to find torrent to add a token for user " << userid;
@@ -1295,7 +1309,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 	} else if (params["action"] == "remove_tokens") {
 		std::string info_hash = hex_decode(params["info_hash"]);
 		int userid = atoi(params["userid"].c_str());
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		auto torrent_it = torrents_list.find(info_hash);
 		if (torrent_it != torrents_list.end()) {
 			torrent_it->second.tokened_users.erase(userid);
@@ -1311,24 +1325,14 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		if (reason_it != params.end()) {
 			reason = atoi(params["reason"].c_str());
 		}
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		auto torrent_it = torrents_list.find(info_hash);
 		if (torrent_it != torrents_list.end()) {
 			syslog(debug) << "Deleting torrent " << torrent_it->second.id << " for the reason '" << get_del_reason(reason) << "'";
-			stats.leechers -= torrent_it->second.leechers.size();
-			stats.seeders -= torrent_it->second.seeders.size();
-			for (auto &p: torrent_it->second.leechers) {
-				p.second.user->decr_leeching();
-			}
-			for (auto &p: torrent_it->second.seeders) {
-				p.second.user->decr_seeding();
-			}
-			std::lock_guard<std::mutex> dr_lock(del_reasons_lock);
-			del_message msg;
-			msg.reason = reason;
-			msg.time = time(NULL);
-			del_reasons[info_hash] = msg;
+			drop_peers(torrent_it->second);
+			del_reasons.add(info_hash, reason, time(NULL));
 			torrents_list.erase(torrent_it);
+			known_torrents.remove(torrents_list);
 		} else {
 			syslog(error) << "Failed to find torrent " << bintohex(info_hash) << " to delete ";
 			response_code = 500;
@@ -1336,12 +1340,13 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 	} else if (params["action"] == "add_user") {
 		std::string passkey = params["passkey"];
 		userid_t userid = strtoint32(params["id"]);
-		std::lock_guard<std::mutex> ul_lock(db->user_list_mutex);
+		std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
 		auto u = users_list.find(passkey);
 		if (u == users_list.end()) {
 			bool protect_ip = params["visible"] == "0";
-			user_ptr tmp_user = std::make_shared<user>(userid, true, protect_ip, false, 0, 0);
+			user_ptr tmp_user = user_arena::create(userid, true, protect_ip, false, 0, 0);
 			users_list.insert(std::pair<std::string, user_ptr>(passkey, tmp_user));
+			passkeys.set(passkey, tmp_user);
 			syslog(debug) << "Added user " << passkey << " with id " << userid;
 		} else {
 			syslog(error) << "Tried to add already known user " << passkey << " with id " << userid;
@@ -1350,30 +1355,41 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		}
 	} else if (params["action"] == "remove_user") {
 		std::string passkey = params["passkey"];
-		std::lock_guard<std::mutex> ul_lock(db->user_list_mutex);
+		std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
 		auto u = users_list.find(passkey);
 		if (u != users_list.end()) {
 			syslog(debug) << "Removed user " << passkey << " with id " << u->second->get_id();
-			u->second->set_deleted(true);
+			user_ptr removed_user = u->second;
+			removed_user->set_deleted(true);
 			users_list.erase(u);
+			passkeys.erase(passkey);
+			user_arena::release(removed_user);
 		}
 	} else if (params["action"] == "remove_users") {
 		// Each passkey is exactly 32 characters long.
-		std::string passkeys = params["passkeys"];
-		std::lock_guard<std::mutex> ul_lock(db->user_list_mutex);
-		for (unsigned int pos = 0; pos < passkeys.length(); pos += 32) {
-			std::string passkey = passkeys.substr(pos, 32);
+		std::string removed_passkeys = params["passkeys"];
+		passkey_table::changes removed;
+		std::vector<user_ptr> removed_users;
+		std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
+		for (unsigned int pos = 0; pos < removed_passkeys.length(); pos += 32) {
+			std::string passkey = removed_passkeys.substr(pos, 32);
 			auto u = users_list.find(passkey);
 			if (u != users_list.end()) {
 				syslog(debug) << "Removed user " << passkey;
+				removed_users.push_back(u->second);
 				u->second->set_deleted(true);
 				users_list.erase(passkey);
+				removed.emplace_back(passkey, nullptr);
 			}
 		}
+		passkeys.update(removed);
+		for (user_ptr removed_user: removed_users) {
+			user_arena::release(removed_user);
+		}
 	} else if (params["action"] == "update_user") {
 		std::string passkey = params["passkey"];
 
-		std::lock_guard<std::mutex> ul_lock(db->user_list_mutex);
+		std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
 		user_list::iterator i = users_list.find(passkey);
 		if (i == users_list.end()) {
 			syslog(error) << "No user with passkey " << passkey << " found when attempting to change leeching status!";
@@ -1423,7 +1439,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		std::string passkey = params["passkey"];
 		time_t pfl = (time_t)atoi(params["time"].c_str());
 
-		std::lock_guard<std::mutex> ul_lock(db->user_list_mutex);
+		std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
 		user_list::iterator i = users_list.find(passkey);
 		if (i == users_list.end()) {
 			syslog(error) << "No user with passkey " << passkey << " found when attempting set personal freeleech!";
@@ -1436,7 +1452,7 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		std::string passkey = params["passkey"];
 		time_t pds = (time_t)atoi(params["time"].c_str());
 
-		std::lock_guard<std::mutex> ul_lock(db->user_list_mutex);
+		std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
 		user_list::iterator i = users_list.find(passkey);
 		if (i == users_list.end()) {
 			syslog(error) << "No user with passkey " << passkey << " found when attempting set personal doubleseed!";
@@ -1447,41 +1463,26 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 		}
 	} else if (params["action"] == "add_blacklist") {
 		std::string peer_id = params["peer_id"];
-		std::lock_guard<std::mutex> wl_lock(db->blacklist_mutex);
-		blacklist.push_back(peer_id);
+		blacklist.add(peer_id);
 		syslog(debug) << "Blacklisted " << peer_id;
 	} else if (params["action"] == "remove_blacklist") {
 		std::string peer_id = params["peer_id"];
-		std::lock_guard<std::mutex> wl_lock(db->blacklist_mutex);
-		for (unsigned int i = 0; i < blacklist.size(); i++) {
-			if (blacklist[i].compare(peer_id) == 0) {
-				blacklist.erase(blacklist.begin() + i);
-				break;
-			}
-		}
+		blacklist.remove(peer_id);
 		syslog(debug) << "De-blacklisted " << peer_id;
 	} else if (params["action"] == "edit_blacklist") {
 		std::string new_peer_id = params["new_peer_id"];
 		std::string old_peer_id = params["old_peer_id"];
-		std::lock_guard<std::mutex> wl_lock(db->blacklist_mutex);
-		for (unsigned int i = 0; i < blacklist.size(); i++) {
-			if (blacklist[i].compare(old_peer_id) == 0) {
-				blacklist.erase(blacklist.begin() + i);
-				break;
-			}
-		}
-		blacklist.push_back(new_peer_id);
+		blacklist.replace(old_peer_id, new_peer_id);
 		syslog(debug) << "Edited blacklist item from " << old_peer_id << " to " << new_peer_id;
 	} else if (params["action"] == "update_announce_interval") {
 		const std::string interval = params["new_announce_interval"];
 		conf->set("tracker", "announce_interval", interval);
-		announce_interval = conf->get_uint("announce_interval");
-		syslog(debug) << "Edited announce interval to " << announce_interval;
+		syslog(debug) << "Edited announce interval to " << conf->get()->announce_interval;
 	} else if (params["action"] == "info_torrent") {
 		std::string info_hash_hex = params["info_hash"];
 		std::string info_hash = hex_decode(info_hash_hex);
 		syslog(debug) << "Info for torrent '" << info_hash_hex << "'";
-		std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
 		auto torrent_it = torrents_list.find(info_hash);
 		if (torrent_it != torrents_list.end()) {
 			syslog(debug) << "Torrent " << torrent_it->second.id
@@ -1496,6 +1497,28 @@ std::string worker::update(params_type &params, client_opts_t &client_opts) {
 	return response("success", client_opts, response_code);
 }
 
+// Needs the torrent list lock. Erasing the peers takes them off the wheel as well
+void worker::drop_peers(torrent &tor) {
+	stats.leechers -= tor.leechers.size();
+	stats.seeders -= tor.seeders.size();
+	for (auto &p: tor.leechers) {
+		user_ptr u = user_arena::get(p.second.user);
+		if (u != nullptr) {
+			u->decr_leeching();
+		}
+		domains_list.peers_changed(p.second.domain, -1);
+	}
+	for (auto &p: tor.seeders) {
+		user_ptr u = user_arena::get(p.second.user);
+		if (u != nullptr) {
+			u->decr_seeding();
+		}
+		domains_list.peers_changed(p.second.domain, -1);
+	}
+	tor.leechers.clear();
+	tor.seeders.clear();
+}
+
 peer_list::iterator worker::add_peer(peer_list &peer_list, const std::string &peer_key) {
 	peer new_peer;
 	auto it = peer_list.insert(std::pair<std::string, peer>(peer_key, new_peer));
@@ -1509,81 +1532,206 @@ void worker::start_reaper() {
 	}
 }
 
+// Answer an announce for a torrent that isn't in the torrent list
+std::string worker::unregistered(const std::string &info_hash, client_opts_t &client_opts) {
+	const tombstone *deleted = del_reasons.find(info_hash);
+	int reason = deleted == nullptr ? -1 : deleted->reason;
+	if (reason < -1 || reason > AUDIENCE) {
+		reason = AUDIENCE + 1; // Unknown codes all read the same
+	}
+	if (!client_opts.gzip && !client_opts.html && !client_opts.json && !client_opts.openmetrics) {
+		return unregistered_responses[client_opts.http_close][reason + 1];
+	}
+	std::string message = "Unregistered torrent";
+	if (reason != -1) {
+		message += ": " + get_del_reason(reason);
+	}
+	return response_error(message, client_opts);
+}
+
+void worker::rebuild_torrent_filter() {
+	std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
+	known_torrents.rebuild(torrents_list);
+}
+
+void worker::rebuild_passkey_table() {
+	std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
+	passkeys.rebuild(users_list);
+}
+
+// Peer keys are a peer id byte, the user id and the peer id
+#define PEER_KEY_ESTIMATE 28
+// Bencoded scrape entries of a torrent, built once it's scraped or announced to
+#define SCRAPE_FRAGMENT_ESTIMATE 80
+
+void worker::get_memory_usage(std::vector<memory_usage> &usage) {
+	{
+		std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
+		uint64_t torrents = torrents_list.size();
+		usage.push_back({"torrents", torrents, bucket_bytes(torrents_list),
+			torrents * pool_object_size(hash_node_size<torrent_list>()),
+			torrents * (string_heap(20) + string_heap(SCRAPE_FRAGMENT_ESTIMATE))});
+		uint64_t tokens = 0;
+		for (auto const &t: torrents_list) {
+			tokens += t.second.tokened_users.size();
+		}
+		usage.push_back({"tokens", tokens, 0, tokens * malloc_size(tree_node_size<slots_list>()), 0});
+	}
+	// Every peer list has about as many buckets as peers, empty ones use a single inline bucket
+	uint64_t peers = stats.seeders + stats.leechers;
+	usage.push_back({"peers", peers, peers * sizeof(void*),
+		peers * pool_object_size(hash_node_size<peer_list>()),
+		peers * string_heap(PEER_KEY_ESTIMATE) + stats.ipv6_peers * (string_heap(16) + string_heap(18))});
+
+	{
+		std::lock_guard<tracker_mutex> ul_lock(db->user_list_mutex);
+		uint64_t users = users_list.size();
+		usage.push_back({"users", users, bucket_bytes(users_list),
+			users * malloc_size(hash_node_size<user_list>()), users * string_heap(32)});
+	}
+	usage.push_back(passkeys.memory());
+	usage.push_back({"user arena", user_arena::size(), 0, user_arena::memory(), 0});
+
+	domain_id domains = domains_list.size();
+	memory_usage domain_usage = {"domains", domains, 0, DOMAIN_MAX * sizeof(std::atomic<domain*>), 0};
+	domain_usage.nodes += domains * (malloc_size(sizeof(domain)) + malloc_size(hash_node_size<std::unordered_map<std::string, domain_id>>()));
+	for (domain_id id = 0; id < domains; id++) {
+		// Once in the domain and once as the key of its id
+		domain_usage.strings += 2 * string_heap(domains_list.get(id)->host.size());
+	}
+	usage.push_back(domain_usage);
+
+	uint64_t tombstones = del_reasons.size();
+	usage.push_back({"deleted torrents", tombstones, 0, tombstones * sizeof(tombstone), 0});
+	usage.push_back({"torrent filter", 1, 0, known_torrents.memory(), 0});
+	usage.push_back({"full scrape", 1, 0, 0, full_scrape_cache.memory()});
+}
+
+void worker::start_full_scrape() {
+	full_scrape_cache.start();
+}
+
 void worker::do_start_reaper() {
+	enter_thread_role(ROLE_REAPER, "reaper");
 	reaper_active = true;
-	reap_peers();
+	// Not cur_time, announces keep updating that while the reaper yields
+	reap_peers(time(NULL));
 	reap_del_reasons();
 	reaper_active = false;
 }
 
-void worker::reap_peers() {
+void worker::reap_peers(time_t now) {
 	syslog(debug) << "Starting peer reaper";
-	cur_time = time(NULL);
+	unsigned int peers_timeout, slice_size;
+	std::chrono::microseconds slice_time;
+	{
+		rcu_read_guard guard;
+		const tracker_config *cfg = conf->get();
+		peers_timeout = cfg->peers_timeout;
+		slice_size = std::max(cfg->reap_slice_size, 1u);
+		slice_time = std::chrono::microseconds(cfg->reap_slice_time);
+	}
 	unsigned int reaped_l = 0, reaped_v4l = 0, reaped_v6l = 0;
 	unsigned int reaped_s = 0, reaped_v4s = 0, reaped_v6s = 0;
-	unsigned int reaped_fl = 0;
+	unsigned int reaped_fl = 0, rescheduled = 0;
 	unsigned int cleared_torrents = 0;
-	std::lock_guard<std::mutex> tl_lock(db->torrent_list_mutex);
-	for (auto torrent = torrents_list.begin(); torrent != torrents_list.end(); torrent++) {
-		bool reaped_this = false; // True if at least one peer was deleted from the current torrent
-		auto p = torrent->second.leechers.begin();
-		peer_list::iterator del_p;
-		while (p != torrent->second.leechers.end()) {
-			if (p->second.last_announced + peers_timeout < cur_time) {
-				if(!p->second.ipv6.empty()) reaped_v6l++;
-				if(!p->second.ipv4.empty()) reaped_v4l++;
-				reaped_l++;
-				reaped_this = true;
-				del_p = p++;
-				del_p->second.user->decr_leeching();
-				torrent->second.leechers.erase(del_p);
-			} else {
-				++p;
-			}
-		}
-		p = torrent->second.seeders.begin();
-		while (p != torrent->second.seeders.end()) {
-			if (p->second.last_announced + peers_timeout < cur_time) {
-				if(!p->second.ipv6.empty()) reaped_v6s++;
-				if(!p->second.ipv4.empty()) reaped_v4s++;
-				reaped_s++;
-				reaped_this = true;
-				del_p = p++;
-				del_p->second.user->decr_seeding();
-				torrent->second.seeders.erase(del_p);
-			} else {
-				++p;
-			}
-		}
-		auto fl = torrent->second.tokened_users.begin();
-		slots_list::iterator del_fl;
-		while (fl != torrent->second.tokened_users.end()) {
-			if (fl->second.free_leech < cur_time && fl->second.double_seed < cur_time) {
-				del_fl = fl++;
-				torrent->second.tokened_users.erase(del_fl);
-				reaped_this = true;
-				reaped_fl++;
-			} else {
-				++fl;
+
+	// Peers are scheduled when they first show up and not moved when they
+	// announce, so the ones still active go back in at their real deadline
+	auto expire_peer = [&](wheel_hook *hook) {
+		peer_hook *h = static_cast<peer_hook*>(hook);
+		peer &p = h->entry->second;
+		time_t deadline = p.last_announced + peers_timeout + 1;
+		if (deadline > now) {
+			peer_expiry.schedule(hook, deadline);
+			rescheduled++;
+			return;
+		}
+		torrent &tor = *h->tor;
+		user_ptr u = user_arena::get(p.user);
+		domains_list.peers_changed(p.domain, -1);
+		bool has_ipv4 = !p.ipv4.empty(), has_ipv6 = !p.ipv6.empty();
+		auto seeder = tor.seeders.find(h->entry->first);
+		if (seeder != tor.seeders.end() && &*seeder == h->entry) {
+			reaped_v4s += has_ipv4;
+			reaped_v6s += has_ipv6;
+			reaped_s++;
+			if (u != nullptr) {
+				u->decr_seeding();
 			}
-		}
-		if (reaped_this) {
-			syslog(trace) << "Reaped peers for torrent: " << torrent->second.id;
+			tor.seeders.erase(seeder);
 		} else {
-			syslog(trace) << "Skipped torrent: " << torrent->second.id;
+			reaped_v4l += has_ipv4;
+			reaped_v6l += has_ipv6;
+			reaped_l++;
+			if (u != nullptr) {
+				u->decr_leeching();
+			}
+			tor.leechers.erase(tor.leechers.find(h->entry->first));
 		}
-		if (reaped_this && torrent->second.seeders.empty() && torrent->second.leechers.empty()) {
-			std::stringstream record;
+		if (tor.seeders.empty() && tor.leechers.empty()) {
+			string_builder record;
 			record << '('
-								<< torrent->second.id << ','
+								<< tor.id << ','
 								<< "0,0,0,"
-								<< torrent->second.balance
+								<< tor.balance
 						 << ')';
-			std::string record_str = record.str();
+			const std::string &record_str = record.str();
 			db->record_torrent(record_str);
 			cleared_torrents++;
 		}
+	};
+	auto expire_token = [&](wheel_hook *hook) {
+		token_hook *h = static_cast<token_hook*>(hook);
+		auto token = h->tor->tokened_users.find(h->userid);
+		time_t deadline = std::max(token->second.free_leech, token->second.double_seed) + 1;
+		if (deadline > now) {
+			token_expiry.schedule(hook, deadline);
+			return;
+		}
+		h->tor->tokened_users.erase(token);
+		reaped_fl++;
+	};
+
+	// Work in slices of at most slice_size hooks or slice_time, letting
+	// announces have the torrent list in between
+	auto cycle_start = std::chrono::steady_clock::now();
+	unsigned int slices = 0;
+	bool peers_done = false, tokens_done = false;
+	while (!peers_done || !tokens_done) {
+		{
+			std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
+			rcu_read_guard guard; // For the users of reaped peers
+			auto slice_start = std::chrono::steady_clock::now();
+			auto slice_end = slice_start + slice_time;
+			unsigned int handled = 0;
+			// Only look at the clock every 64 hooks
+			auto in_budget = [&]() {
+				return ++handled < slice_size && ((handled & 63) != 0 || std::chrono::steady_clock::now() < slice_end);
+			};
+			if (!peers_done) {
+				peers_done = peer_expiry.advance(now, [&](wheel_hook *hook) {
+					expire_peer(hook);
+					return in_budget();
+				});
+			}
+			if (peers_done && !tokens_done && handled < slice_size) {
+				tokens_done = token_expiry.advance(now, [&](wheel_hook *hook) {
+					expire_token(hook);
+					return in_budget();
+				});
+			}
+			reaper_slice_duration.observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - slice_start).count());
+		}
+		slices++;
+		if (!peers_done || !tokens_done) {
+			std::this_thread::yield();
+		}
 	}
+	uint64_t cycle_usecs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - cycle_start).count();
+	stats.reaper_cycles++;
+	stats.reaper_last_slices = slices;
+	stats.reaper_last_cycle_usecs = cycle_usecs;
 
 	if (reaped_l || reaped_v4l || reaped_v6l || reaped_s || reaped_v4s || reaped_v6s) {
 		stats.leechers   -= reaped_l;
@@ -1592,25 +1740,59 @@ void worker::reap_peers() {
 		stats.ipv6_peers -= (reaped_v6l + reaped_v6s);
 	}
 
-	syslog(debug) << "Reaped " << reaped_l << " leechers, " << reaped_s << " seeders and " << reaped_fl << " tokens. Reset " << cleared_torrents << " torrents";
+	syslog(debug) << "Reaped " << reaped_l << " leechers, " << reaped_s << " seeders and " << reaped_fl << " tokens. Reset "
+		<< cleared_torrents << " torrents, rescheduled " << rescheduled << " active peers. "
+		<< slices << " slices in " << cycle_usecs << " us";
+}
+
+// Needs the torrent list lock
+void worker::track_peer(torrent &tor, peer_list::value_type &entry, time_t deadline) {
+	entry.second.expiry.tor = &tor;
+	entry.second.expiry.entry = &entry;
+	peer_expiry.schedule(&entry.second.expiry, deadline);
+}
+
+// Needs the torrent list lock
+void worker::track_token(torrent &tor, int userid, slots_t &slots) {
+	slots.expiry.tor = &tor;
+	slots.expiry.userid = userid;
+	token_expiry.schedule(&slots.expiry, std::max(slots.free_leech, slots.double_seed) + 1);
+}
+
+// Peers and tokens loaded from the database aren't scheduled to expire yet
+void worker::track_loaded() {
+	unsigned int peers_timeout;
+	{
+		rcu_read_guard guard;
+		peers_timeout = conf->get()->peers_timeout;
+	}
+	std::lock_guard<tracker_mutex> tl_lock(db->torrent_list_mutex);
+	for (auto &t: torrents_list) {
+		for (peer_list *list: {&t.second.leechers, &t.second.seeders}) {
+			for (auto &p: *list) {
+				if (!p.second.expiry.linked()) {
+					track_peer(t.second, p, p.second.last_announced + peers_timeout + 1);
+				}
+			}
+		}
+		for (auto &token: t.second.tokened_users) {
+			if (!token.second.expiry.linked()) {
+				track_token(t.second, token.first, token.second);
+			}
+		}
+	}
 }
 
 void worker::reap_del_reasons()
 {
 	syslog(debug) << "Starting del reason reaper";
-	time_t max_time = time(NULL) - del_reason_lifetime;
-	unsigned int reaped = 0;
-	for (auto reason = del_reasons.begin(); reason != del_reasons.end();) {
-		if (reason->second.time <= max_time) {
-			auto del_it = reason++;
-			std::lock_guard<std::mutex> dr_lock(del_reasons_lock);
-			del_reasons.erase(del_it);
-			reaped++;
-			continue;
-		}
-		reason++;
-	}
-	syslog(debug) << "Reaped " << reaped << " del reasons";
+	time_t max_time;
+	{
+		rcu_read_guard guard;
+		max_time = time(NULL) - conf->get()->del_reason_lifetime;
+	}
+	size_t reaped = del_reasons.expire(max_time);
+	syslog(debug) << "Reaped " << reaped << " del reasons, " << del_reasons.size() << " left";
 }
 
 std::string worker::get_del_reason(int code)
@@ -1693,72 +1875,44 @@ std::string worker::get_del_reason(int code)
 
 /* Peers should be invisible if they are a leecher without
    download privs or their IP is invalid */
-bool worker::peer_is_visible(user_ptr &u, peer *p) {
+bool worker::peer_is_visible(const user_ptr &u, peer *p) {
 	return (p->left == 0 || u->can_leech());
 }
 
-std::string worker::get_host(params_type &headers){
-
-	std::string host = "unknown";
+domain_id worker::get_domain(params_type &headers) {
 	// Search for host or x-forwarded-host headers
 	auto head_itr = headers.find("x-forwarded-host");
-	if (head_itr == headers.end())
+	if (head_itr == headers.end()) {
 		head_itr = headers.find("host");
+		if (head_itr == headers.end()) {
+			return 0; // Unknown
+		}
+	}
 
-	// If we found a header then record it
-	if (head_itr != headers.end())
-		host = head_itr->second;
-
-	return trim(host);
+	// Trimmed in place, interning a known host doesn't allocate
+	const std::string &host = head_itr->second;
+	size_t begin = host.find_first_not_of(" \t");
+	if (begin == std::string::npos) {
+		return domains_list.intern(host.data(), 0);
+	}
+	size_t end = host.find_last_not_of(" \t") + 1;
+	return domains_list.intern(host.data() + begin, end - begin);
 }
 
 std::string worker::bencode_int(int data) {
-	std::string bencoded_int = "i";
-	bencoded_int += inttostr(data);
-	bencoded_int += "e";
+	std::string bencoded_int;
+	bencoded_int.reserve(INT_BUFFER_SIZE + 2);
+	bencoded_int += 'i';
+	append_int(bencoded_int, data);
+	bencoded_int += 'e';
 	return bencoded_int;
 }
 
-std::string worker::bencode_str(std::string data) {
-	std::string bencoded_str = inttostr(data.size());
-	bencoded_str += ":";
+std::string worker::bencode_str(const std::string &data) {
+	std::string bencoded_str;
+	bencoded_str.reserve(INT_BUFFER_SIZE + 1 + data.size());
+	append_uint(bencoded_str, data.size());
+	bencoded_str += ':';
 	bencoded_str += data;
 	return bencoded_str;
 }
-
-#if defined(__DEBUG_BUILD__)
-/*
- *  Allow any addresses in a debug build, it's expected
- *  that we will generate local traffic for testing.
- */
-bool worker::ipv4_is_public(in_addr addr){return true;}
-bool worker::ipv6_is_public(in6_addr addr){return true;}
-#else
-bool worker::ipv4_is_public(in_addr addr){
-
-	// Match against reserved ranges
-	if ((ntohl(addr.s_addr) & 0xff000000) == 0x0a000000) return false; // 10.0.0.0/8
-	if ((ntohl(addr.s_addr) & 0xfff00000) == 0xac100000) return false; // 172.16.0.0/12
-	if ((ntohl(addr.s_addr) & 0xffff0000) == 0xc0a80000) return false; // 192.168.0.0/16
-	if ((ntohl(addr.s_addr) & 0xffff0000) == 0xa9fe0000) return false; // 169.254.0.0/16
-	if ((ntohl(addr.s_addr) & 0xffc00000) == 0x64400000) return false; // 100.64.0.0/10
-	if ((ntohl(addr.s_addr) & 0xff000000) == 0x7f000000) return false; // 127.0.0.0/8
-	return true;
-
-}
-
-bool worker::ipv6_is_public(in6_addr addr){
-
-	// Match against reserved ranges
-	if (ntohl(addr.s6_addr32[0]) == 0x00000000) return false; // Loopback / v4 compat v6
-	if (ntohs(addr.s6_addr16[0]) == 0xfe80    ) return false; // Link local
-	if (ntohs(addr.s6_addr16[0]) == 0xfc00    ) return false; // Unique Local - private subnet
-	if (ntohs(addr.s6_addr16[0]) == 0xfec0    ) return false; // site-local [deprecated]
-	if (ntohs(addr.s6_addr16[0]) == 0x3ffe    ) return false; // 6bone [deprecated]
-	if (ntohl(addr.s6_addr32[0]) == 0x20010db8) return false; // documentation examples, unroutable
-	if (ntohl(addr.s6_addr32[0]) == 0x20010000) return false; // Teredo
-	if (ntohs(addr.s6_addr16[0]) == 0x2002    ) return false; // 6to4
-	return true;
-
-}
-#endif
@@ -20,6 +20,13 @@
 #include <ctime>
 
 #include "radiance.h"
+#include "blacklist.h"
+#include "ip_address.h"
+#include "scrape.h"
+#include "timing_wheel.h"
+#include "unregistered.h"
+#include "user.h"
+#include "memory.h"
 class database;
 class site_comm;
 
@@ -31,44 +38,39 @@ class worker {
 		site_comm * s_comm;
 		torrent_list &torrents_list;
 		user_list &users_list;
+		passkey_table passkeys;
 		domain_list &domains_list;
-		std::vector<std::string> &blacklist;
-		std::unordered_map<std::string, del_message> del_reasons;
+		client_blacklist &blacklist;
+		infohash_filter known_torrents;
+		tombstone_index del_reasons;
+		std::string unregistered_responses[2][AUDIENCE + 3]; // By http_close and delete reason + 1
 		tracker_status status;
 		bool reaper_active;
+		full_scrape full_scrape_cache;
+		timing_wheel peer_expiry;  // Both only used with the torrent list locked
+		timing_wheel token_expiry;
 		time_t cur_time;
 
-		unsigned int announce_interval;
-		unsigned int del_reason_lifetime;
-		unsigned int peers_timeout;
-		unsigned int numwant_limit;
-		bool keepalive_enabled, anonymous;
-		std::string real_ip_header;
-		std::string site_password;
-		std::string report_password;
-		std::string anonymous_password;
-
-		std::mutex del_reasons_lock;
-		void load_config();
 		void do_start_reaper();
-		void reap_peers();
 		void reap_del_reasons();
-		bool ipv4_is_public(in_addr addr);
-		bool ipv6_is_public(in6_addr addr);
+		void track_peer(torrent &tor, peer_list::value_type &entry, time_t deadline);
+		void track_token(torrent &tor, int userid, slots_t &slots);
+		void track_loaded();
 		static std::string get_del_reason(int code);
+		std::string unregistered(const std::string &info_hash, client_opts_t &client_opts);
 		peer_list::iterator add_peer(peer_list &peer_list, const std::string &peer_id);
-		static inline bool peer_is_visible(user_ptr &u, peer *p);
-		std::string get_host(params_type &headers);
-		std::string bencode_int(int data);
-		std::string bencode_str(std::string data);
+		void drop_peers(torrent &tor);
+		static inline bool peer_is_visible(const user_ptr &u, peer *p);
+		domain_id get_domain(params_type &headers);
 
 	public:
-		worker(torrent_list &torrents, user_list &users, domain_list &domains, std::vector<std::string> &_blacklist, database * db_obj, site_comm * sc);
-		void reload_config();
-		std::string work(const std::string &input, std::string &ip, uint16_t &ip_ver, client_opts_t &client_opts);
-		std::string announce(const std::string &input, torrent &tor, user_ptr &u, domain_ptr &d, params_type &params, params_type &headers, std::string &ip, uint16_t &ip_ver, client_opts_t &client_opts);
+		worker(torrent_list &torrents, user_list &users, domain_list &domains, client_blacklist &_blacklist, database * db_obj, site_comm * sc);
+		std::string work(const std::string &input, const ip_address &client_addr, client_opts_t &client_opts);
+		std::string announce(const std::string &input, torrent &tor, const user_ptr &u, domain_id d, params_type &params, params_type &headers, const ip_address &client_addr, client_opts_t &client_opts);
 		std::string scrape(const std::list<std::string> &infohashes, params_type &headers, client_opts_t &client_opts);
 		std::string update(params_type &params, client_opts_t &client_opts);
+		static std::string bencode_int(int data);
+		static std::string bencode_str(const std::string &data);
 
 		void reload_lists();
 		bool shutdown();
@@ -76,5 +78,11 @@ class worker {
 		const inline tracker_status get_status() { return status; }
 
 		void start_reaper();
+		// One reaper pass up to now, on the calling thread
+		void reap_peers(time_t now);
+		void start_full_scrape();
+		void rebuild_torrent_filter();
+		void rebuild_passkey_table();
+		void get_memory_usage(std::vector<memory_usage> &usage);
 };
 #endif